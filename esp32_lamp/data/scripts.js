@@ -81,55 +81,33 @@ function applyAlarmStateToUI() {
     updateAlarmStatus(alarm.enabled && alarm.time ? "Alarm: set for " + alarm.time : "Alarm: off");
 }
 
-function sendBrightness(value) {
+// With fadeMs the lamp fades to the new brightness by itself, one request for the whole ramp
+function sendBrightness(value, fadeMs, onSent) {
     currentBrightness = value;
     var xhr = new XMLHttpRequest();
-    xhr.open("GET", "/brightness?value=" + value, true);
+    var url = "/brightness?value=" + value;
+    if (fadeMs) url += "&fade=" + Math.round(fadeMs);
+    xhr.open("GET", url, true);
+    if (onSent) xhr.onloadend = onSent;
     xhr.send();
 }
 
 function rampBrightness(target, durationMs, onComplete) {
-    var tickMs = 1000;
-    var steps = Math.max(1, Math.floor(durationMs / tickMs));
     var current = currentBrightness;
     if (current >= target) {
         sendBrightness(target);
         if (onComplete) onComplete();
         return;
     }
-    var delta = target - current;
-    var step = Math.max(1, Math.round(delta / steps));
-
-    var interval = setInterval(() => {
-        current += step;
-        if (current >= target) {
-            current = target;
-        }
-        sendBrightness(current);
-        if (current >= target) {
-            clearInterval(interval);
-            if (onComplete) onComplete();
-        }
-    }, tickMs);
+    sendBrightness(target, durationMs);
+    if (onComplete) setTimeout(onComplete, durationMs);
 }
 
 function rampBrightnessFast(target) {
-    var durationMs = 10 * 1000;
-    var tickMs = 200;
-    var steps = Math.max(1, Math.floor(durationMs / tickMs));
-    var current = 0;
-    var step = Math.max(1, Math.round(target / steps));
-
-    var interval = setInterval(() => {
-        current += step;
-        if (current >= target) {
-            current = target;
-        }
-        sendBrightness(current);
-        if (current >= target) {
-            clearInterval(interval);
-        }
-    }, tickMs);
+    // Start from the dimmest level, then fade up over 10 s
+    sendBrightness(1, 0, function () {
+        sendBrightness(target, 10 * 1000);
+    });
 }
 
 function updateAlarmStatus(text) {
@@ -0,0 +1,117 @@
+#include "LampProtocol.h"
+
+uint8_t LampProtocol::crc8(const uint8_t *data, uint8_t length, uint8_t crc) {
+    for (uint8_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// Build a complete frame into 'frame' (at least MAX_FRAME bytes). Returns the number of bytes to send.
+uint8_t LampProtocol::encode(uint8_t type, const uint8_t *payload, uint8_t length, uint8_t *frame) {
+    if (length > MAX_PAYLOAD)
+        return 0;
+    frame[0] = SYNC;
+    frame[1] = length;
+    frame[2] = type;
+    memcpy(frame + HEADER_SIZE, payload, length);
+    frame[HEADER_SIZE + length] = crc8(frame + 1, length + 2);
+    return HEADER_SIZE + length + 1;
+}
+
+uint8_t LampProtocol::encodeState(const LampState &state, uint16_t sequence, uint8_t *frame) {
+    const uint8_t payload[STATE_PAYLOAD] = {(uint8_t)sequence, (uint8_t)(sequence >> 8),
+                                            state.r, state.g, state.b, state.mode, state.brightness,
+                                            (uint8_t)state.fade, (uint8_t)(state.fade >> 8),
+                                            (uint8_t)(state.fade >> 16), (uint8_t)(state.fade >> 24)};
+    return encode(LAMP_MSG_STATE, payload, STATE_PAYLOAD, frame);
+}
+
+bool LampProtocol::decodeState(const uint8_t *payload, uint8_t length, LampState &state, uint16_t &sequence) {
+    if (length != STATE_PAYLOAD && length != STATE_PAYLOAD_NO_FADE)
+        return false;
+    sequence = payload[0] | (payload[1] << 8);
+    state.r = payload[2];
+    state.g = payload[3];
+    state.b = payload[4];
+    state.mode = payload[5];
+    state.brightness = payload[6];
+    state.fade = 0;
+    if (length == STATE_PAYLOAD)
+        state.fade = payload[7] | (payload[8] << 8) | ((uint32_t)payload[9] << 16) | ((uint32_t)payload[10] << 24);
+    return true;
+}
+
+// Same target state, whatever the fade time to get there
+bool LampProtocol::sameState(const LampState &a, const LampState &b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b && a.mode == b.mode && a.brightness == b.brightness;
+}
+
+// ACK and HEARTBEAT only carry a sequence number
+uint8_t LampProtocol::encodeSequence(uint8_t type, uint16_t sequence, uint8_t *frame) {
+    const uint8_t payload[SEQUENCE_PAYLOAD] = {(uint8_t)sequence, (uint8_t)(sequence >> 8)};
+    return encode(type, payload, SEQUENCE_PAYLOAD, frame);
+}
+
+bool LampProtocol::decodeSequence(const uint8_t *payload, uint8_t length, uint16_t &sequence) {
+    if (length != SEQUENCE_PAYLOAD)
+        return false;
+    sequence = payload[0] | (payload[1] << 8);
+    return true;
+}
+
+// Push one received byte through the decoder. Returns true when a complete frame with a valid CRC
+// has arrived, its type and payload stay available until the next call.
+bool LampProtocol::feed(uint8_t byte) {
+    switch (_state) {
+    case WAIT_SYNC:
+        if (byte == SYNC)
+            _state = WAIT_LENGTH;
+        break;
+    case WAIT_LENGTH:
+        if (byte > MAX_PAYLOAD) {
+            _lengthErrors++;
+            _state = WAIT_SYNC;
+            break;
+        }
+        _length = byte;
+        _crc = crc8(&byte, 1);
+        _state = WAIT_TYPE;
+        break;
+    case WAIT_TYPE:
+        _type = byte;
+        _crc = crc8(&byte, 1, _crc);
+        _index = 0;
+        _state = _length > 0 ? WAIT_PAYLOAD : WAIT_CRC;
+        break;
+    case WAIT_PAYLOAD:
+        _payload[_index++] = byte;
+        _crc = crc8(&byte, 1, _crc);
+        if (_index >= _length)
+            _state = WAIT_CRC;
+        break;
+    case WAIT_CRC:
+        _state = WAIT_SYNC;
+        if (byte != _crc) {
+            _crcErrors++;
+            return false;
+        }
+        _frames++;
+        return true;
+    }
+    return false;
+}
+
+// A frame has started but is not complete yet
+bool LampProtocol::isReceiving() { return _state != WAIT_SYNC; }
+
+uint8_t LampProtocol::getType() { return _type; }
+uint8_t LampProtocol::getLength() { return _length; }
+const uint8_t *LampProtocol::getPayload() { return _payload; }
+
+uint32_t LampProtocol::getFrames() { return _frames; }
+uint32_t LampProtocol::getCrcErrors() { return _crcErrors; }
+uint32_t LampProtocol::getLengthErrors() { return _lengthErrors; }
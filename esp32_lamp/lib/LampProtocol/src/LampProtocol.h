@@ -0,0 +1,90 @@
+/*"""
+
+ Binary Lamp Protocol:
+ Every frame is [SYNC][LEN][TYPE][PAYLOAD ...][CRC8]
+   SYNC    = 0xA5
+   LEN     = number of payload bytes
+   TYPE    = message type (LampMessageType)
+   CRC8    = CRC-8 (polynomial 0x07) over LEN, TYPE and PAYLOAD
+
+   - STATE: sequence (2 bytes, little endian), r, g, b, mode, brightness, fade (4 bytes, little endian)
+     The whole lamp state travels in one frame so the receiver can apply it atomically.
+     fade is the time in ms to blend from the current state into this one, 0 switches at once.
+     A STATE without the fade field (7 bytes payload) is still accepted and switches at once.
+   - ACK: sequence
+     Sent by the Teensy with the sequence of the state it has applied.
+   - HEARTBEAT: sequence
+     Sent by the ESP32 while nothing changes, with the sequence of its current state.
+     The Teensy answers with an ACK, a mismatch makes the ESP32 push its state again.
+   Sequence 0 means "no state applied yet".
+
+ This file is shared between esp32_lamp and teensy_lamp, keep both copies identical.
+
+"""*/
+#ifndef LampProtocol_H
+#define LampProtocol_H
+#include "Arduino.h"
+#include <inttypes.h>
+
+enum LampMessageType {
+    LAMP_MSG_STATE = 0x01,
+    LAMP_MSG_ACK = 0x02,
+    LAMP_MSG_HEARTBEAT = 0x03,
+};
+
+struct LampState {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t mode;
+    uint8_t brightness;
+    uint32_t fade; // ms, not part of the state itself, see sameState()
+};
+
+class LampProtocol {
+public:
+    static const uint8_t SYNC = 0xA5;
+    static const uint8_t MAX_PAYLOAD = 32;
+    static const uint8_t HEADER_SIZE = 3; // SYNC, LEN, TYPE
+    static const uint8_t MAX_FRAME = HEADER_SIZE + MAX_PAYLOAD + 1;
+    static const uint8_t STATE_PAYLOAD = 11;
+    static const uint8_t STATE_PAYLOAD_NO_FADE = 7;
+    static const uint8_t SEQUENCE_PAYLOAD = 2;
+
+    static uint8_t crc8(const uint8_t *data, uint8_t length, uint8_t crc = 0);
+    static uint8_t encode(uint8_t type, const uint8_t *payload, uint8_t length, uint8_t *frame);
+    static uint8_t encodeState(const LampState &state, uint16_t sequence, uint8_t *frame);
+    static bool decodeState(const uint8_t *payload, uint8_t length, LampState &state, uint16_t &sequence);
+    static bool sameState(const LampState &a, const LampState &b);
+    static uint8_t encodeSequence(uint8_t type, uint16_t sequence, uint8_t *frame);
+    static bool decodeSequence(const uint8_t *payload, uint8_t length, uint16_t &sequence);
+
+    bool feed(uint8_t byte);
+    bool isReceiving();
+    uint8_t getType();
+    uint8_t getLength();
+    const uint8_t *getPayload();
+
+    uint32_t getFrames();
+    uint32_t getCrcErrors();
+    uint32_t getLengthErrors();
+
+private:
+    enum DecoderState { WAIT_SYNC,
+                        WAIT_LENGTH,
+                        WAIT_TYPE,
+                        WAIT_PAYLOAD,
+                        WAIT_CRC };
+    DecoderState _state = WAIT_SYNC;
+    uint8_t _length = 0;
+    uint8_t _type = 0;
+    uint8_t _index = 0;
+    uint8_t _crc = 0;
+    uint8_t _payload[MAX_PAYLOAD];
+
+    uint32_t _frames = 0;
+    uint32_t _crcErrors = 0;
+    uint32_t _lengthErrors = 0;
+};
+
+#endif
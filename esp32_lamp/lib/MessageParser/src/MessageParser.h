@@ -0,0 +1,93 @@
+/*"""
+
+ Message Parser:
+ Parses the body of an ASCII message (everything between the start and end markers) in place.
+ The first character selects a MessageDescriptor from a constexpr table, the rest is decoded as one
+ bounded decimal or hex number and handed to the descriptor's handler. Nothing is copied or moved,
+ and a message that is malformed or out of range is rejected instead of wrapping around.
+
+   constexpr MessageDescriptor<SerialHandler> table[] = {
+       // type, base, min digits, max digits, min value, max value, handler
+       {'R', 10, 1, 3, 0, 255, &setRed},
+   };
+   parseMessage(table, handler, body, length);
+
+ Header only and free of Arduino dependencies, so the same file compiles for esp32_lamp, teensy_lamp,
+ touch_sensing and the native build. Keep all copies identical.
+
+"""*/
+#ifndef MessageParser_H
+#define MessageParser_H
+#include <stddef.h>
+#include <stdint.h>
+
+enum MessageParseResult {
+    MESSAGE_OK = 0,
+    MESSAGE_UNKNOWN_TYPE,
+    MESSAGE_BAD_FORMAT,
+    MESSAGE_OUT_OF_RANGE,
+};
+
+template <typename Target>
+struct MessageDescriptor {
+    char type;
+    uint8_t base; // 10 or 16
+    uint8_t minDigits;
+    uint8_t maxDigits;
+    uint32_t minValue;
+    uint32_t maxValue; // must stay below 2^28 so the decoder cannot overflow
+    void (*handler)(Target &target, uint32_t value);
+};
+
+// Value of one decimal or hex digit, or 0xFF if the character is not a digit in that base
+inline uint8_t messageDigitValue(char c, uint8_t base) {
+    uint8_t d = (uint8_t)(c - '0');
+    if (d < 10)
+        return d;
+    if (base != 16)
+        return 0xFF;
+    d = (uint8_t)((c | 0x20) - 'a'); // fold to lower case
+    return d < 6 ? d + 10 : 0xFF;
+}
+
+// Decode [digits, digits + length) as an unsigned number. Stops as soon as the value exceeds maxValue.
+inline MessageParseResult decodeMessageNumber(const char *digits, uint8_t length, uint8_t base, uint32_t maxValue, uint32_t &value) {
+    uint32_t result = 0;
+    for (uint8_t i = 0; i < length; i++) {
+        uint8_t d = messageDigitValue(digits[i], base);
+        if (d == 0xFF)
+            return MESSAGE_BAD_FORMAT;
+        result = result * base + d;
+        if (result > maxValue)
+            return MESSAGE_OUT_OF_RANGE;
+    }
+    value = result;
+    return MESSAGE_OK;
+}
+
+// Parse one message body of 'length' characters, the first one being the message type
+template <typename Target, size_t N>
+MessageParseResult parseMessage(const MessageDescriptor<Target> (&table)[N], Target &target, const char *message, uint8_t length) {
+    if (length == 0)
+        return MESSAGE_UNKNOWN_TYPE;
+    for (size_t i = 0; i < N; i++) {
+        const MessageDescriptor<Target> &descriptor = table[i];
+        if (descriptor.type != message[0])
+            continue;
+
+        uint8_t digits = length - 1;
+        if (digits < descriptor.minDigits || digits > descriptor.maxDigits)
+            return MESSAGE_BAD_FORMAT;
+        uint32_t value = 0;
+        MessageParseResult result = decodeMessageNumber(message + 1, digits, descriptor.base, descriptor.maxValue, value);
+        if (result != MESSAGE_OK)
+            return result;
+        if (value < descriptor.minValue)
+            return MESSAGE_OUT_OF_RANGE;
+        descriptor.handler(target, value);
+        return MESSAGE_OK;
+    }
+    return MESSAGE_UNKNOWN_TYPE;
+}
+
+#endif
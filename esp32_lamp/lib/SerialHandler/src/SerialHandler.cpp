@@ -9,10 +9,25 @@
  Different values inside the payload are separated by a '_separator'.
  SERIAL_SEPERATOR_CH = '#'
 _separator = '#'
+
+ Binary frames (see LampProtocol.h) are accepted between ASCII messages.
+
+ State sync with the Teensy:
+ setState() only sends when the state actually changed, tagged with a new sequence number.
+ The Teensy ACKs the sequence it applied. Unacked state is retransmitted after _retransmitTimeout,
+ backing off up to _heartbeatInterval. While everything is acked only a HEARTBEAT goes out every
+ _heartbeatInterval, and an ACK for an older sequence (e.g. the Teensy rebooted) triggers a push.
+ While a state is in flight, ACKs for older ones are late and ignored, only the timeout resends.
+
+ Frame profiler of the Teensy:
+ queryStats() sends <P0> (or <P1> to start a new window). The Teensy answers in plain text, one line per
+ stage up to a "P end" line, which is collected until isStatsReady() and read with getStats().
 """*/
 void SerialHandler::update() {
     _printPeriodically(_printFrequency, _debug);
     _receiveNonBlocking();
+    _updateStats();
+    _updateSync();
 }
 
 void SerialHandler::setSerial(Stream &serial) {
@@ -28,57 +43,226 @@ void SerialHandler::setStartMarker(char startMarker) { _startMarker = startMarke
 
 void SerialHandler::setSeperator(char seperator) { _separator = seperator; }
 
+// Drain everything the UART has into the ring buffer, then parse up to _receiveBudget bytes of it.
+// Bytes over the budget wait in the ring buffer for the next update instead of piling up in the UART.
 void SerialHandler::_receiveNonBlocking() {
-    static boolean recvInProgress = false;
-    static byte ndx = 0;
-    char rc;
+    int available = _serial->available();
+    while (available-- > 0) {
+        uint16_t next = (_ringHead + 1) & _ringMask;
+        if (next == _ringTail) {
+            _overflows++;
+            break;
+        }
+        _ring[_ringHead] = _serial->read();
+        _ringHead = next;
+    }
 
-    if (_serial->available() <= 0)
-        return;
+    uint16_t budget = _receiveBudget;
+    while (_ringTail != _ringHead && budget > 0) {
+        char rc = _ring[_ringTail];
+        _ringTail = (_ringTail + 1) & _ringMask;
+        budget--;
+        _bytesInWindow++;
+        _receiveByte(rc);
+    }
+}
 
-    rc = _serial->read();
+void SerialHandler::_receiveByte(char rc) {
+    if (!_recvInProgress && (_protocol.isReceiving() || (uint8_t)rc == LampProtocol::SYNC)) {
+        if (_protocol.feed(rc)) {
+            _messagesInWindow++;
+            _handlePacket(_protocol.getType(), _protocol.getPayload(), _protocol.getLength());
+        }
+        return;
+    }
+    // Everything outside binary frames shows on the console once
     Serial.write(rc);
-    if (recvInProgress == true) {
+    if (_recvInProgress == true) {
         if (rc != _endMarker) {
-            _receivedChars[ndx] = rc;
-            ndx++;
-            if (ndx >= _numChars) {
+            _receivedChars[_ndx] = rc;
+            _ndx++;
+            if (_ndx >= _numChars) {
                 this->pln("Buffer Overflow");
-                ndx = _numChars - 1;
+                _overflows++;
+                _ndx = _numChars - 1;
             }
         } else {
             // digitalWrite(13, !digitalRead(13));
-            _receivedChars[ndx] = '\0'; // terminate the string when the end marker arrives
-            recvInProgress = false;
-            ndx = 0;
-            this->parseString(_receivedChars);
+            _receivedChars[_ndx] = '\0'; // terminate the string when the end marker arrives
+            _recvInProgress = false;
+            _messagesInWindow++;
+            this->parseString(_receivedChars, _ndx);
+            _ndx = 0;
         }
     } else if (rc == _startMarker) {
-        recvInProgress = true;
+        _recvInProgress = true;
     } else {
-        Serial.print(rc);
+        _receiveStats(rc);
     }
 }
 
-void SerialHandler::parseString(char *string) {
-    const char seperator[2] = {_separator, '\0'};
-    char messageType = string[0];
-    // Remove the first character from the string using memmove. First character is the message type.
-    memmove(string, string + 1, strlen(string));
+// Plain text outside messages is the answer to a stats query
+void SerialHandler::_receiveStats(char rc) {
+    static const char endLine[] = "P end\n";
+    static const uint16_t endLength = sizeof(endLine) - 1;
+    if (!_statsPending)
+        return;
+    if (_statsLength < _statsSize - 1)
+        _stats[_statsLength++] = rc;
+    _stats[_statsLength] = '\0';
+    if (rc != '\n')
+        return;
+    bool lineStart = _statsLength == endLength || (_statsLength > endLength && _stats[_statsLength - endLength - 1] == '\n');
+    if (lineStart && strcmp(_stats + _statsLength - endLength, endLine) == 0)
+        _statsPending = false;
+}
 
-    switch (messageType) {
-    case 'C': {
+// Ask the Teensy for its frame profiler stats, reset starts a new window over there
+void SerialHandler::queryStats(bool reset) {
+    _statsLength = 0;
+    _stats[0] = '\0';
+    _statsPending = true;
+    sendMessage('P', reset ? 1 : 0);
+}
 
-        break;
+// The whole answer to the last queryStats() is in
+bool SerialHandler::isStatsReady() { return !_statsPending && _statsLength > 0; }
+const char *SerialHandler::getStats() { return _stats; }
+
+void SerialHandler::_updateStats() {
+    uint32_t elapsed = millis() - _statsTimer;
+    if (elapsed < 1000)
+        return;
+    _bytesPerSecond = _bytesInWindow * 1000.0f / elapsed;
+    _messagesPerSecond = _messagesInWindow * 1000.0f / elapsed;
+    _bytesInWindow = 0;
+    _messagesInWindow = 0;
+    _statsTimer = millis();
+}
+
+void SerialHandler::setReceiveBudget(uint16_t bytesPerUpdate) { _receiveBudget = bytesPerUpdate; }
+
+float SerialHandler::getBytesPerSecond() { return _bytesPerSecond; }
+float SerialHandler::getMessagesPerSecond() { return _messagesPerSecond; }
+// Ring buffer full while the UART still had data, or a message longer than the message buffer
+uint32_t SerialHandler::getOverflows() { return _overflows; }
+
+// Handlers for the ASCII messages, see messageTable below
+struct SerialMessages {
+    // <M0>: LED mode
+    static void setMode(SerialHandler &handler, uint32_t value) {
+        if (handler.mode)
+            *handler.mode = value;
     }
-    case 'M': {
+};
 
+static constexpr MessageDescriptor<SerialHandler> messageTable[] = {
+    // type, base, min digits, max digits, min value, max value, handler
+    {'M', 10, 1, 3, 0, 255, &SerialMessages::setMode},
+};
+
+// Parse the body of one ASCII message in place, e.g. "R255" for <R255>
+void SerialHandler::parseString(const char *message, uint8_t length) {
+    if (parseMessage(messageTable, *this, message, length) != MESSAGE_OK)
+        _rejectedMessages++;
+}
+
+// Malformed, unknown or out of range ASCII messages
+uint32_t SerialHandler::getRejectedMessages() { return _rejectedMessages; }
+
+// Send a binary frame (see LampProtocol.h) in a single write
+void SerialHandler::sendPacket(uint8_t type, const uint8_t *payload, uint8_t length) {
+    uint8_t frame[LampProtocol::MAX_FRAME];
+    uint8_t frameLength = LampProtocol::encode(type, payload, length, frame);
+    _serial->write(frame, frameLength);
+}
+
+// Send an ASCII message such as <M2> in a single write, without a line terminator
+bool SerialHandler::sendMessage(char type, long value) {
+    return msg().p(_startMarker).p(type).p(value).p(_endMarker).send();
+}
+
+// Push the state to the Teensy if it differs from the last one. The fade time only applies to a change,
+// the same state with another fade time is not sent again.
+void SerialHandler::setState(const LampState &state) {
+    if (LampProtocol::sameState(state, _state))
+        return;
+    _state = state;
+    // Sequence 0 is reserved for "nothing applied yet"
+    if (++_sequence == 0)
+        _sequence = 1;
+    _acked = false;
+    _retransmitDelay = _retransmitTimeout;
+    _sendState();
+}
+
+void SerialHandler::_sendState() {
+    uint8_t frame[LampProtocol::MAX_FRAME];
+    uint8_t frameLength = LampProtocol::encodeState(_state, _sequence, frame);
+    _serial->write(frame, frameLength);
+    _lastSendTime = millis();
+    _lastSendMicros = micros();
+}
+
+void SerialHandler::_sendHeartbeat() {
+    uint8_t frame[LampProtocol::MAX_FRAME];
+    uint8_t frameLength = LampProtocol::encodeSequence(LAMP_MSG_HEARTBEAT, _sequence, frame);
+    _serial->write(frame, frameLength);
+    _lastSendTime = millis();
+    _lastSendMicros = micros();
+}
+
+void SerialHandler::_updateSync() {
+    if (_sequence == 0)
+        return;
+    uint32_t sinceSend = millis() - _lastSendTime;
+    if (!_acked) {
+        if (sinceSend < _retransmitDelay)
+            return;
+        _retransmits++;
+        // Back off while the Teensy does not answer, so a disconnected link settles at the heartbeat rate
+        _retransmitDelay = min(_retransmitDelay * 2, _heartbeatInterval);
+        _sendState();
+    } else if (sinceSend >= _heartbeatInterval) {
+        _sendHeartbeat();
+    }
+}
+
+void SerialHandler::_handlePacket(uint8_t type, const uint8_t *payload, uint8_t length) {
+    switch (type) {
+    case LAMP_MSG_ACK: {
+        uint16_t sequence;
+        if (!LampProtocol::decodeSequence(payload, length, sequence))
+            break;
+        if (sequence != _sequence) {
+            // A late ACK of an older state while the current one is in flight: the timeout resends it if needed
+            if (!_acked)
+                break;
+            // A heartbeat answered with an older state, the Teensy missed the current one
+            _acked = false;
+            _retransmits++;
+            _retransmitDelay = _retransmitTimeout;
+            _sendState();
+            break;
+        }
+        // Round trip of the last state or heartbeat frame
+        _latency = micros() - _lastSendMicros;
+        _acked = true;
+        _acks++;
         break;
     }
     }
-    return;
 }
 
+void SerialHandler::setRetransmitTimeout(uint32_t timeout) { _retransmitTimeout = timeout; }
+void SerialHandler::setHeartbeatInterval(uint32_t interval) { _heartbeatInterval = interval; }
+bool SerialHandler::isAcked() { return _acked; }
+uint16_t SerialHandler::getSequence() { return _sequence; }
+// Round trip time in microseconds from sending a frame to its ACK
+uint32_t SerialHandler::getLatency() { return _latency; }
+uint32_t SerialHandler::getRetransmits() { return _retransmits; }
+uint32_t SerialHandler::getAcks() { return _acks; }
+
 void SerialHandler::_printPeriodically(float freq, bool debug = false) {
     if (freq <= 0)
         return;
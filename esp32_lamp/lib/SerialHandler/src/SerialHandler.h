@@ -15,11 +15,15 @@
 #ifndef SerialHandler_H
 #define SerialHandler_H
 #include "Arduino.h"
+#include "LampProtocol.h"
+#include "MessageParser.h"
 #include "advancedSerial.h"
 #include <inttypes.h>
 
 
 class SerialHandler : public advancedSerial {
+    friend struct SerialMessages;
+
 public:
     void update();
     void setSerial(Stream &serial);
@@ -29,10 +33,28 @@ public:
     void setSeperator(char seperator);
     void setDebug(bool debug);
     void setPrintFrequency(float printFrequency);
-    void parseString(char *string);
+    void setReceiveBudget(uint16_t bytesPerUpdate);
+    void parseString(const char *message, uint8_t length);
+    uint32_t getRejectedMessages();
+    void sendPacket(uint8_t type, const uint8_t *payload, uint8_t length);
+    bool sendMessage(char type, long value);
+    void setState(const LampState &state);
+    void setRetransmitTimeout(uint32_t timeout);
+    void setHeartbeatInterval(uint32_t interval);
+    bool isAcked();
+    uint16_t getSequence();
+    uint32_t getLatency();
+    uint32_t getRetransmits();
+    uint32_t getAcks();
     char getStartMarker();
     char getEndMarker();
-    Stream &getSerial();    
+    Stream &getSerial();
+    float getBytesPerSecond();
+    float getMessagesPerSecond();
+    uint32_t getOverflows();
+    void queryStats(bool reset);
+    bool isStatsReady();
+    const char *getStats();
 
 private:
     float _printFrequency = 50;
@@ -48,7 +70,51 @@ private:
     char _receivedChars[_numChars];
     void _printPeriodically(float frequency, bool debug);
     void _receiveNonBlocking(void);
-    int* mode;
+    void _receiveByte(char rc);
+    void _receiveStats(char rc);
+    void _updateStats(void);
+
+    // Received bytes wait here until they are parsed. Size must be a power of two.
+    static const uint16_t _ringSize = 256;
+    static const uint16_t _ringMask = _ringSize - 1;
+    uint8_t _ring[_ringSize];
+    uint16_t _ringHead = 0;
+    uint16_t _ringTail = 0;
+    uint16_t _receiveBudget = 128;
+    bool _recvInProgress = false;
+    byte _ndx = 0;
+
+    uint32_t _statsTimer = 0;
+    uint32_t _bytesInWindow = 0;
+    uint32_t _messagesInWindow = 0;
+    float _bytesPerSecond = 0;
+    float _messagesPerSecond = 0;
+    uint32_t _overflows = 0;
+    uint32_t _rejectedMessages = 0;
+    int* mode = nullptr;
+
+    // Answer to the last stats query, the Teensy's report is about 400 bytes
+    static const uint16_t _statsSize = 1024;
+    char _stats[_statsSize] = "";
+    uint16_t _statsLength = 0;
+    bool _statsPending = false;
+
+    void _handlePacket(uint8_t type, const uint8_t *payload, uint8_t length);
+    void _sendState();
+    void _sendHeartbeat();
+    void _updateSync();
+    LampProtocol _protocol;
+    LampState _state = {};
+    uint16_t _sequence = 0;
+    bool _acked = true;
+    uint32_t _retransmitTimeout = 100; // ms
+    uint32_t _retransmitDelay = 100;   // ms, current delay including backoff
+    uint32_t _heartbeatInterval = 5000; // ms
+    uint32_t _lastSendTime = 0;
+    uint32_t _lastSendMicros = 0;
+    uint32_t _latency = 0;
+    uint32_t _retransmits = 0;
+    uint32_t _acks = 0;
 };
 
 #include "Arduino.h"
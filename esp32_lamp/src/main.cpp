@@ -8,6 +8,8 @@
 #include <WiFiClient.h>
 
 SerialHandler SH;
+// USB serial log, written out only when the loop is idle
+advancedLogger logger;
 
 int red;
 int green;
@@ -118,11 +120,34 @@ void loadBrightness() {
     currentBrightness = constrain(line.toInt(), 1, 100);
     file.close();
 }
+
+// Hand the whole lamp state to the sync layer. It is sent as one binary frame, and only if it changed.
+// With a fade time the Teensy blends into the new state by itself over that many ms.
+void sendState(uint32_t fade = 0) {
+    LampState state;
+    state.r = red;
+    state.g = green;
+    state.b = blue;
+    state.mode = command.toInt();
+    // The Teensy scales its effects by the strongest channel of the color
+    state.brightness = max(red, max(green, blue));
+    state.fade = fade;
+    SH.setState(state);
+}
+
+// Optional "fade" argument of a request, in ms
+uint32_t fadeArg() {
+    if (!server.hasArg("fade"))
+        return 0;
+    return constrain(server.arg("fade").toInt(), 0L, 3600000L);
+}
+
 void setup() {
     // Start all serial ports
     Serial.begin(115200);
     Serial1.begin(115200);
 
+    logger.setPrinter(Serial);
     SH.setSerial(Serial1);
 
     if (!WiFi.config(local_IP, gateway, subnet, primaryDNS)) {
@@ -152,6 +177,7 @@ void setup() {
     red = strtol(&lastColor[1], NULL, 16);
     green = strtol(&lastColor[3], NULL, 16);
     blue = strtol(&lastColor[5], NULL, 16);
+    sendState();
 
     // OTA Setup
     ArduinoOTA.setHostname("ESP32-OTA");
@@ -250,8 +276,8 @@ void setup() {
         if (server.hasArg("value")) {
             command = server.arg("value");
 
-            SH.p("<").p("M" + command).pln(">");
-            Serial.println("Command " + command + " activated.");
+            sendState(fadeArg());
+            logger.vv().p("Command ").p(command.c_str()).p(" activated.").ln().send();
 
             // Send a response back to the client
             server.send(200, "text/plain", "Command " + command + " activated.");
@@ -283,18 +309,10 @@ void setup() {
             saveColor(colorHex);
 
             // Send the color to the Teensy
-            SH.p("<").p("R").p(red).pln(">");
-            SH.p("<").p("G").p(green).pln(">");
-            SH.p("<").p("B").p(blue).pln(">");
+            sendState(fadeArg());
 
             // Handle the RGB values as needed (send to LEDs, etc.)
-            Serial.print("Color changed to: ");
-            Serial.print("R: ");
-            Serial.print(red);
-            Serial.print(", G: ");
-            Serial.print(green);
-            Serial.print(", B: ");
-            Serial.println(blue);
+            logger.vv().p("Color changed to: R: ").p(red).p(", G: ").p(green).p(", B: ").p(blue).ln().send();
 
             // Send a response back to the client
             server.send(200, "text/plain", "Color updated successfully");
@@ -304,7 +322,7 @@ void setup() {
         }
     });
 
-    // Brightness handler
+    // Brightness handler, /brightness?value=<1-100>[&fade=<ms>]
     server.on("/brightness", HTTP_GET, []() {
         if (server.hasArg("value")) {
             String brightnessStr = server.arg("value");
@@ -346,18 +364,10 @@ void setup() {
             saveColor(colorHex);
 
             // Send the color to the Teensy
-            SH.p("<").p("R").p(red).pln(">");
-            SH.p("<").p("G").p(green).pln(">");
-            SH.p("<").p("B").p(blue).pln(">");
+            sendState(fadeArg());
 
             // Handle the RGB values as needed (send to LEDs, etc.)
-            Serial.print("Color changed to: ");
-            Serial.print("R: ");
-            Serial.print(red);
-            Serial.print(", G: ");
-            Serial.print(green);
-            Serial.print(", B: ");
-            Serial.println(blue);
+            logger.vv().p("Color changed to: R: ").p(red).p(", G: ").p(green).p(", B: ").p(blue).ln().send();
 
             server.send(200, "text/plain", "Brightness set to " + String(brightness) + ". Color is" + String(red) + " " + String(green) + " " + String(blue));
         } else {
@@ -365,6 +375,20 @@ void setup() {
         }
     });
 
+    // Frame profiler of the Teensy, /stats[?reset=1] starts a new window after this report
+    server.on("/stats", HTTP_GET, []() {
+        SH.queryStats(server.hasArg("reset") && server.arg("reset") == "1");
+        uint32_t start = millis();
+        while (!SH.isStatsReady() && millis() - start < 500) {
+            SH.update();
+            delay(1);
+        }
+        if (SH.isStatsReady())
+            server.send(200, "text/plain", SH.getStats());
+        else
+            server.send(504, "text/plain", "No answer from the Teensy");
+    });
+
     // Start the server
     server.begin();
     Serial.print("Server started on ");
@@ -374,19 +398,13 @@ void loop() {
     ArduinoOTA.handle(); // Listen for OTA updates
 
     server.handleClient();
-    static long sendTimer = 0;
-    if (millis() - sendTimer > 1000) {
-        sendTimer = millis();
-        SH.p("<").p("R").p(red).pln(">");
-        SH.p("<").p("G").p(green).pln(">");
-        SH.p("<").p("B").p(blue).pln(">");
-        SH.p("<").p("M").p(command).pln(">");
-    }
     SH.update();
+    logger.drain();
     static long printTimer = 0;
     if (millis() - printTimer > 2000) {
         printTimer = millis();
-        Serial.print("Server running on ");
-        Serial.println(WiFi.localIP());
+        logger.v().p("Server running on ").p(WiFi.localIP().toString().c_str()).ln().send();
+        logger.v().p("Link: seq ").p(SH.getSequence()).p(SH.isAcked() ? " acked" : " pending").p(", latency ").p(SH.getLatency()).p(" us, acks ").p(SH.getAcks())
+            .p(", retransmits ").p(SH.getRetransmits()).p(", log dropped ").p(logger.getDropped()).ln().send();
     }
 }
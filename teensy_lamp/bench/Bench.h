@@ -0,0 +1,26 @@
+/*"""
+
+ Bench:
+ Host benchmarks of the lamp code ([env:native_bench]). Every benchmark prints its own report and
+ returns false if a sanity check on its results failed.
+
+"""*/
+#ifndef Bench_H
+#define Bench_H
+#include <chrono>
+#include <stdint.h>
+
+// Wall clock for the host benchmarks, independent of the virtual Arduino clock
+inline uint64_t benchNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool benchMessageParser();
+bool benchEffects();
+bool benchLayout();
+bool benchSpace();
+bool benchNoise();
+bool benchColor();
+bool benchCompositor();
+
+#endif
@@ -0,0 +1,221 @@
+// Host comparison of the CRGB framebuffer against the hand-rolled packed 0xRRGGBB code it replaced:
+// the same per-frame color work done both ways (sunlight flicker, lightning mix, crossfade, dimming,
+// rainbow, packing into the drawing memory), plus spot checks of the FastLED math the effects rely on.
+// The native FastLED is a plain C++ stand-in, on the Teensy scale8/blend8 compile to a few instructions each.
+#include "Bench.h"
+#include "ColorWheel.h"
+#include "Effects.h"
+#include "OutputStage.h"
+#include <Arduino.h>
+#include <FastLED.h>
+#include <OctoWS2811.h>
+
+static const uint16_t LED_COUNT = 247;
+static const uint32_t frames = 20000;
+
+static uint32_t packedA[LED_COUNT];
+static uint32_t packedB[LED_COUNT];
+static uint32_t packedOut[LED_COUNT];
+static CRGB crgbA[LED_COUNT];
+static CRGB crgbB[LED_COUNT];
+static CRGB crgbOut[LED_COUNT];
+static int8_t flickers[LED_COUNT];
+static uint8_t levels[LED_COUNT];
+static int displayMemory[LED_COUNT * 3 / 4 + 1];
+static int drawingMemory[LED_COUNT * 3 / 4 + 1];
+
+// Keeps the compiler from dropping work whose result is never used
+static volatile uint32_t sink;
+
+// Runs one frame of work 'frames' times, returns ns per frame
+template <typename Work>
+static double timeFrames(Work work) {
+    uint64_t start = benchNanos();
+    for (uint32_t i = 0; i < frames; i++)
+        work(i);
+    return (double)(benchNanos() - start) / frames;
+}
+
+static void compare(const char *name, double handRolled, double crgb) {
+    printf("%-24s: hand-rolled %8.1f ns/frame, CRGB %8.1f ns/frame (%.2fx)\n", name, handRolled, crgb, handRolled / crgb);
+}
+
+static bool checkMath() {
+    bool ok = true;
+    if (scale8(255, 255) != 255 || scale8(255, 0) != 0 || scale8(128, 128) != 64) {
+        printf("scale8 is off\n");
+        ok = false;
+    }
+    // The video variant never turns a lit channel off
+    if (scale8_video(1, 1) != 1 || scale8_video(0, 200) != 0 || scale8_video(200, 0) != 0) {
+        printf("scale8_video is off\n");
+        ok = false;
+    }
+    for (uint16_t a = 0; a < 256 && ok; a++) {
+        for (uint16_t b = 0; b < 256; b++) {
+            if (blend8(a, b, 0) != a || blend8(a, b, 255) != b) {
+                printf("blend8(%u, %u) does not end on its inputs\n", a, b);
+                ok = false;
+                break;
+            }
+        }
+    }
+    if (CRGB(CHSV(0, 255, 255)) != CRGB(255, 0, 0) || CRGB(CHSV(96, 255, 255)) != CRGB(0, 255, 0) ||
+        CRGB(CHSV(160, 255, 255)) != CRGB(0, 0, 255) || CRGB(CHSV(123, 0, 255)) != CRGB(255, 255, 255) || CRGB(CHSV(50, 255, 0)) != CRGB::Black) {
+        printf("hsv2rgb_rainbow is off\n");
+        ok = false;
+    }
+    CRGB dim = CRGB(1, 100, 255);
+    dim.nscale8_video(10);
+    if (dim != CRGB(1, 4, 10)) {
+        printf("nscale8_video gave %u, %u, %u\n", dim.r, dim.g, dim.b);
+        ok = false;
+    }
+    return ok;
+}
+
+bool benchColor() {
+    bool ok = checkMath();
+    FastRandom random(11);
+    for (uint16_t i = 0; i < LED_COUNT; i++) {
+        packedA[i] = random.next() & 0xFFFFFF;
+        packedB[i] = random.next() & 0xFFFFFF;
+        crgbA[i] = CRGB(packedA[i]);
+        crgbB[i] = CRGB(packedB[i]);
+        levels[i] = random.next();
+    }
+    random.fillRange(flickers, LED_COUNT, -10, 11);
+
+    // Sunlight: a base color with a flicker per LED, clamped
+    const uint32_t warm = packColor(255, 128, 0);
+    double handRolled = timeFrames([&](uint32_t f) {
+        int r1 = (warm >> 16) & 0xFF, g1 = (warm >> 8) & 0xFF, b1 = warm & 0xFF;
+        for (uint16_t i = 0; i < LED_COUNT; i++) {
+            int flicker = flickers[(i + f) % LED_COUNT];
+            packedOut[i] = packColor(constrain(r1 + flicker, 0, 255), constrain(g1 + flicker, 0, 255), constrain(b1 + flicker, 0, 255));
+        }
+        sink += packedOut[f % LED_COUNT];
+    });
+    double crgb = timeFrames([&](uint32_t f) {
+        for (uint16_t i = 0; i < LED_COUNT; i++) {
+            int8_t flicker = flickers[(i + f) % LED_COUNT];
+            CRGB color = CRGB(255, 128, 0);
+            crgbOut[i] = flicker >= 0 ? color.addToRGB(flicker) : color.subtractFromRGB(-flicker);
+        }
+        sink += crgbOut[f % LED_COUNT].g;
+    });
+    compare("sunlight flicker", handRolled, crgb);
+    for (uint16_t i = 0; i < LED_COUNT; i++) {
+        if (CRGB(packedOut[i]) != crgbOut[i]) {
+            printf("sunlight flicker differs at LED %u\n", i);
+            ok = false;
+            break;
+        }
+    }
+
+    // Thunder: lightning mixed over a blue background by the glow of every LED
+    const uint32_t lightning = packColor(235, 220, 250);
+    handRolled = timeFrames([&](uint32_t f) {
+        uint8_t lr = lightning >> 16, lg = (uint8_t)(lightning >> 8), lb = (uint8_t)lightning;
+        for (uint16_t i = 0; i < LED_COUNT; i++) {
+            uint16_t a = (uint8_t)(levels[i] + f) + 1;
+            uint16_t inverse = 256 - a;
+            packedOut[i] = packColor((lr * a) >> 8, (lg * a) >> 8, (lb * a + 50 * inverse) >> 8);
+        }
+        sink += packedOut[f % LED_COUNT];
+    });
+    crgb = timeFrames([&](uint32_t f) {
+        for (uint16_t i = 0; i < LED_COUNT; i++)
+            crgbOut[i] = blend(CRGB(0, 0, 50), CRGB(lightning), levels[i] + f);
+        sink += crgbOut[f % LED_COUNT].b;
+    });
+    compare("lightning mix", handRolled, crgb);
+
+    // Transition: two whole frames crossfaded, red/blue and green in one multiply each vs blend()
+    handRolled = timeFrames([&](uint32_t f) {
+        uint32_t amount = f & 0xFF;
+        uint32_t inverse = 256 - amount;
+        for (uint16_t i = 0; i < LED_COUNT; i++) {
+            uint32_t rb = ((packedA[i] & 0xFF00FF) * inverse + (packedB[i] & 0xFF00FF) * amount) >> 8;
+            uint32_t g = ((packedA[i] & 0x00FF00) * inverse + (packedB[i] & 0x00FF00) * amount) >> 8;
+            packedOut[i] = (rb & 0xFF00FF) | (g & 0x00FF00);
+        }
+        sink += packedOut[f % LED_COUNT];
+    });
+    crgb = timeFrames([&](uint32_t f) {
+        blend(crgbA, crgbB, crgbOut, LED_COUNT, f);
+        sink += crgbOut[f % LED_COUNT].r;
+    });
+    compare("crossfade", handRolled, crgb);
+
+    // Dimming a whole frame: unpack, float scale and clamp as the old brightness pass did, vs nscale8_video
+    handRolled = timeFrames([&](uint32_t f) {
+        float brightness = 100 + (f & 0x3F);
+        for (uint16_t i = 0; i < LED_COUNT; i++) {
+            uint32_t color = packedA[i];
+            uint8_t r = max(0, min(255, ((color >> 16) & 0xFF) * brightness / 255));
+            uint8_t g = max(0, min(255, ((color >> 8) & 0xFF) * brightness / 255));
+            uint8_t b = max(0, min(255, (color & 0xFF) * brightness / 255));
+            packedOut[i] = packColor(r, g, b);
+        }
+        sink += packedOut[f % LED_COUNT];
+    });
+    crgb = timeFrames([&](uint32_t f) {
+        memcpy(crgbOut, crgbA, sizeof(crgbOut));
+        nscale8_video(crgbOut, LED_COUNT, 100 + (f & 0x3F));
+        sink += crgbOut[f % LED_COUNT].r;
+    });
+    compare("dimming", handRolled, crgb);
+
+    // Rainbow: Wheel() and a divide per pixel vs the gradient over the hsv2rgb_rainbow table
+    HueGradient gradient;
+    gradient.begin(LED_COUNT);
+    handRolled = timeFrames([&](uint32_t f) {
+        for (uint16_t i = 0; i < LED_COUNT; i++)
+            packedOut[i] = Wheel((f * 5 + (i * 256 / LED_COUNT)) & 255);
+        sink += packedOut[f % LED_COUNT];
+    });
+    crgb = timeFrames([&](uint32_t f) {
+        gradient.render(crgbOut, f * 5 * 256);
+        sink += crgbOut[f % LED_COUNT].r;
+    });
+    compare("rainbow", handRolled, crgb);
+
+    // Output: the output stage's packed write as it was (brightness table, GRB, no layout) vs its CRGB pass
+    OctoWS2811 leds(LED_COUNT, displayMemory, drawingMemory, WS2811_GRB | WS2811_800kHz, 1);
+    static uint16_t lut[256];
+    for (uint16_t value = 0; value < 256; value++)
+        lut[value] = value << 8;
+    // Color order and layout are only known at run time in the output stage
+    static volatile uint8_t order[3] = {1, 0, 2};
+    static const uint16_t *volatile layout = nullptr;
+    handRolled = timeFrames([&](uint32_t f) {
+        uint8_t *drawing = (uint8_t *)drawingMemory;
+        const uint16_t *physical = layout;
+        uint8_t offsetR = order[0], offsetG = order[1], offsetB = order[2];
+        for (uint16_t i = 0; i < LED_COUNT; i++) {
+            uint32_t color = packedA[i];
+            uint8_t *dest = drawing + (physical ? physical[i] : i) * 3;
+            dest[offsetR] = lut[(color >> 16) & 0xFF] >> 8;
+            dest[offsetG] = lut[(color >> 8) & 0xFF] >> 8;
+            dest[offsetB] = lut[color & 0xFF] >> 8;
+        }
+        sink += drawingMemory[f % 16];
+    });
+    OutputStage output;
+    output.begin(leds, drawingMemory, LED_COUNT, WS2811_GRB | WS2811_800kHz);
+    crgb = timeFrames([&](uint32_t f) {
+        output.write(crgbA);
+        sink += drawingMemory[f % 16];
+    });
+    compare("into OctoWS2811 memory", handRolled, crgb);
+    for (uint16_t i = 0; i < LED_COUNT; i++) {
+        if ((uint32_t)leds.getPixel(i) != packedA[i]) {
+            printf("output stage wrote %06X for LED %u, the frame has %06X\n", leds.getPixel(i), i, packedA[i]);
+            ok = false;
+            break;
+        }
+    }
+    printf("%-24s: %u bytes CRGB, %u bytes packed\n", "framebuffer", (unsigned)sizeof(crgbA), (unsigned)sizeof(packedA));
+    return ok;
+}
@@ -0,0 +1,214 @@
+// Host check of the layer compositor: the four blend modes on single colors, the thunder and sunlight
+// change ranges against a diff of their frames, and a long run of sunlight with lightning and a moving
+// brightness bar where every composited frame has to equal blending all layers over all LEDs.
+// Then the cost per frame with dirty ranges against blending everything every frame.
+#include "Bench.h"
+#include "Compositor.h"
+#include "Effects.h"
+#include "FrameClock.h"
+#include <Arduino.h>
+
+static const uint16_t LED_COUNT = 247;
+static const uint32_t frames = 20000;
+
+static CRGB frame[LED_COUNT];
+static CRGB effectPixels[LED_COUNT];
+static CRGB lightningPixels[LED_COUNT];
+static CRGB barPixels[LED_COUNT];
+static uint8_t barAlpha[LED_COUNT];
+static CRGB reference[LED_COUNT];
+static CRGB previous[LED_COUNT];
+static LedBuffer buffer = {frame, LED_COUNT};
+
+// Keeps the compiler from dropping work whose result is never used
+static volatile uint32_t sink;
+
+// Every layer over every LED, straight from the definition of the modes
+static void blendAll(Compositor &compositor) {
+    for (uint16_t i = 0; i < LED_COUNT; i++) {
+        CRGB out = CRGB::Black;
+        for (uint8_t n = 0; n < Compositor::maxLayers; n++) {
+            Layer &layer = compositor.getLayer(n);
+            if (!layer.isEnabled() || !layer.getPixels())
+                continue;
+            CRGB color = layer.getPixels()[i];
+            switch (layer.getMode()) {
+            case BLEND_REPLACE:
+                out = color;
+                break;
+            case BLEND_ADD:
+                out += color;
+                break;
+            case BLEND_ALPHA:
+                out = blend(out, color, layer.getAlpha() ? layer.getAlpha()[i] : 255);
+                break;
+            case BLEND_MAX:
+                out = CRGB(max(out.r, color.r), max(out.g, color.g), max(out.b, color.b));
+                break;
+            }
+        }
+        reference[i] = out;
+    }
+}
+
+static bool checkModes() {
+    static CRGB base[1];
+    static CRGB top[1];
+    static uint8_t alpha[1];
+    static CRGB out[1];
+    LedBuffer single = {out, 1};
+    Compositor compositor;
+    compositor.begin(single);
+    compositor.getLayer(0).begin(base, BLEND_REPLACE);
+    compositor.getLayer(1).begin(top, BLEND_REPLACE, alpha);
+    base[0] = CRGB(200, 100, 10);
+    top[0] = CRGB(100, 200, 0);
+    alpha[0] = 255;
+
+    struct Case {
+        BlendMode mode;
+        uint8_t alpha;
+        CRGB expected;
+    };
+    const Case cases[] = {
+        {BLEND_REPLACE, 0, CRGB(100, 200, 0)},
+        {BLEND_ADD, 0, CRGB(255, 255, 10)},
+        {BLEND_ALPHA, 0, CRGB(200, 100, 10)},
+        {BLEND_ALPHA, 255, CRGB(100, 200, 0)},
+        {BLEND_ALPHA, 128, blend(CRGB(200, 100, 10), CRGB(100, 200, 0), 128)},
+        {BLEND_MAX, 0, CRGB(200, 200, 10)},
+    };
+    FrameClock clock;
+    bool ok = true;
+    for (const Case &c : cases) {
+        compositor.getLayer(1).setMode(c.mode);
+        alpha[0] = c.alpha;
+        compositor.getLayer(1).markDirty();
+        compositor.render(clock.tick(0));
+        if (out[0] != c.expected) {
+            printf("blend mode %u, alpha %u: %02X%02X%02X, expected %02X%02X%02X\n", c.mode, c.alpha, out[0].r, out[0].g, out[0].b,
+                   c.expected.r, c.expected.g, c.expected.b);
+            ok = false;
+        }
+    }
+    // Nothing changed, nothing blended
+    if (compositor.render(clock.tick(0)) || compositor.getBlended() != 0) {
+        printf("compositor blended an unchanged stack\n");
+        ok = false;
+    }
+    return ok;
+}
+
+// An effect's change range has to cover every LED that differs from the previous frame
+static bool checkChanged(const char *name, Effect &effect, uint32_t interval) {
+    FrameClock clock;
+    seedEffects(3);
+    effect.begin(buffer);
+    uint32_t now = 0;
+    uint64_t covered = 0;
+    for (uint32_t f = 0; f < 30000; f++) {
+        memcpy(previous, frame, sizeof(frame));
+        now += interval;
+        effect.render(clock.tick(now), buffer);
+        uint16_t first, end;
+        effect.getChanged(LED_COUNT, first, end);
+        covered += end - first;
+        for (uint16_t i = 0; i < LED_COUNT; i++) {
+            if (frame[i] != previous[i] && (i < first || i >= end)) {
+                printf("%s changed LED %u outside of %u..%u in frame %u\n", name, i, first, end, f);
+                effect.end();
+                return false;
+            }
+        }
+    }
+    effect.end();
+    printf("%-24s: %6.1f of %u LEDs reported changed per frame\n", name, (double)covered / 30000, LED_COUNT);
+    return true;
+}
+
+static void setBar(Layer &bar, uint16_t &shown, uint16_t length) {
+    uint16_t first = min(length, shown);
+    uint16_t end = max(length, shown);
+    memset(barAlpha + first, length > shown ? 255 : 0, end - first);
+    bar.markDirty(first, end);
+    shown = length;
+}
+
+// Sunlight with lightning over it and a bar that grows and shrinks now and then, every frame checked
+static bool checkStack(Effect &base, const char *name, bool fullEveryFrame, double &nanos, double &blended) {
+    static ThunderEffect lightning;
+    Compositor compositor;
+    compositor.begin(buffer);
+    Layer &effectLayer = compositor.getLayer(0);
+    Layer &lightningLayer = compositor.getLayer(1);
+    Layer &bar = compositor.getLayer(2);
+    effectLayer.begin(effectPixels, BLEND_REPLACE);
+    lightning.setBackground(false);
+    lightningLayer.begin(lightningPixels, BLEND_MAX);
+    bar.begin(barPixels, BLEND_ALPHA, barAlpha);
+    memset(barAlpha, 0, sizeof(barAlpha));
+    fill_solid(barPixels, LED_COUNT, CRGB(0, 255, 0));
+
+    seedEffects(9);
+    effectLayer.setEffect(&base);
+    lightningLayer.setEffect(&lightning);
+    FastRandom random(4);
+    FrameClock clock;
+    uint16_t shown = 0;
+    uint64_t elapsed = 0;
+    uint32_t now = 0;
+    bool ok = true;
+    for (uint32_t f = 0; f < frames; f++) {
+        // Someone touches the pads now and then for a while
+        if (f % 1000 == 0)
+            bar.setEnabled(random.chance(128));
+        if (bar.isEnabled() && f % 5 == 0) {
+            int length = shown + random.range(-3, 4);
+            setBar(bar, shown, constrain(length, 0, LED_COUNT));
+        }
+        if (fullEveryFrame)
+            compositor.markDirty();
+        now += 20000;
+        uint64_t start = benchNanos();
+        compositor.render(clock.tick(now));
+        elapsed += benchNanos() - start;
+        sink += frame[f % LED_COUNT].r;
+        if (f % 7 == 0 && ok) {
+            blendAll(compositor);
+            if (memcmp(reference, frame, sizeof(frame)) != 0) {
+                printf("%s: frame %u differs from blending every layer\n", name, f);
+                ok = false;
+            }
+        }
+    }
+    effectLayer.setEffect(nullptr);
+    lightningLayer.setEffect(nullptr);
+    nanos = (double)elapsed / frames;
+    blended = (double)compositor.getTotalBlended() / frames;
+    return ok;
+}
+
+bool benchCompositor() {
+    bool ok = true;
+    ok &= checkModes();
+    ThunderEffect lightningOnly;
+    lightningOnly.setBackground(false);
+    ok &= checkChanged("thunder", thunderEffect, 20000);
+    ok &= checkChanged("lightning without sky", lightningOnly, 20000);
+    ok &= checkChanged("sunlight, 5 ms frames", sunlightEffect, 5000);
+
+    struct Stack {
+        const char *name;
+        Effect *base;
+    };
+    colorEffect.setColor(packColor(40, 20, 200));
+    const Stack stacks[] = {{"sunlight", &sunlightEffect}, {"color", &colorEffect}, {"rainbow", &rainbowEffect}};
+    for (const Stack &stack : stacks) {
+        double fullNanos, fullBlended, dirtyNanos, dirtyBlended;
+        ok &= checkStack(*stack.base, stack.name, true, fullNanos, fullBlended);
+        ok &= checkStack(*stack.base, stack.name, false, dirtyNanos, dirtyBlended);
+        printf("%-9s+ lightning + bar: everything %7.1f ns/frame, dirty ranges %7.1f ns/frame, %5.1f LEDs blended (%.2fx)\n", stack.name,
+               fullNanos, dirtyNanos, dirtyBlended, fullNanos / dirtyNanos);
+    }
+    return ok;
+}
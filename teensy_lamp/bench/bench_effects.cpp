@@ -0,0 +1,468 @@
+// Host benchmark of one frame of the render loop: every effect on its own, then the stages that
+// follow it in renderFrame()/showFrame() (frame hash, brightness + packing, show).
+// The virtual clock moves one frame interval per rendered frame, so time based effects go through
+// their whole cycle (thunder flashes, fades) the way they do on the lamp.
+#include "Bench.h"
+#include "ColorWheel.h"
+#include "Effects.h"
+#include "FrameClock.h"
+#include "FrameScheduler.h"
+#include "OutputStage.h"
+#include "Transition.h"
+#include <Arduino.h>
+#include <OctoWS2811.h>
+
+static const uint16_t LED_COUNT = 247;
+static const uint32_t FRAME_INTERVAL_US = 20000;
+static const uint32_t frames = 20000;
+
+static CRGB frame[LED_COUNT];
+// The hand-rolled code below still works on packed 0xRRGGBB colors
+static uint32_t packedFrame[LED_COUNT];
+static int displayMemory[LED_COUNT * 3 / 4 + 1];
+static int drawingMemory[LED_COUNT * 3 / 4 + 1];
+
+// Keeps the compiler from dropping work whose result is never used
+static volatile uint32_t sink;
+
+static uint32_t packed(const CRGB &color) { return packColor(color.r, color.g, color.b); }
+
+static double report(const char *name, uint64_t nanos) {
+    double perFrame = (double)nanos / frames;
+    printf("%-24s: %10.1f ns/frame\n", name, perFrame);
+    return perFrame;
+}
+
+static LedBuffer buffer = {frame, LED_COUNT};
+static FrameClock frameClock;
+
+// One effect of the registry in isolation, at its own frame interval
+static double benchEffect(Effect &effect) {
+    seedEffects(1);
+    memset(frame, 0, sizeof(frame));
+    effect.begin(buffer);
+    uint64_t elapsed = 0;
+    uint64_t worst = 0;
+    for (uint32_t i = 0; i < frames; i++) {
+        nativeAdvanceMicros(effect.getFrameInterval());
+        uint64_t start = benchNanos();
+        effect.render(frameClock.tick(micros()), buffer);
+        uint64_t took = benchNanos() - start;
+        elapsed += took;
+        worst = max(worst, took);
+        sink += packed(frame[i % LED_COUNT]);
+    }
+    effect.end();
+    double perFrame = (double)elapsed / frames;
+    printf("%-24s: %10.1f ns/frame, worst %llu ns\n", effect.getName(), perFrame, (unsigned long long)worst);
+    return perFrame;
+}
+
+// The rainbow with an HSV conversion per pixel and a divide for its hue
+static void hsvRainbow(CRGB *frame, uint16_t ledCount, int hue) {
+    for (int i = 0; i < ledCount; i++)
+        hsv2rgb_rainbow(CHSV((hue + (i * 256 / ledCount)) & 255, 255, 255), frame[i]);
+}
+
+static bool benchColorWheel() {
+    bool ok = true;
+    const CRGB *wheel = rainbowWheel();
+    for (int i = 0; i < 256; i++) {
+        if (wheel[i] != CRGB(CHSV(i, 255, 255))) {
+            printf("rainbowWheel()[%d] = %06X, hsv2rgb_rainbow = %06X\n", i, packed(wheel[i]), packed(CRGB(CHSV(i, 255, 255))));
+            ok = false;
+        }
+    }
+
+    static CRGB reference[LED_COUNT];
+    HueGradient gradient;
+    gradient.begin(LED_COUNT);
+    for (int hue = 0; hue < 256; hue++) {
+        hsvRainbow(reference, LED_COUNT, hue);
+        gradient.render(frame, hue << 8);
+        if (memcmp(reference, frame, sizeof(frame)) != 0) {
+            printf("hue gradient differs from hsv2rgb_rainbow at hue %d\n", hue);
+            ok = false;
+            break;
+        }
+    }
+
+    uint64_t start = benchNanos();
+    for (uint32_t i = 0; i < frames; i++) {
+        hsvRainbow(frame, LED_COUNT, i * 5);
+        sink += packed(frame[i % LED_COUNT]);
+    }
+    double perPixel = report("rainbow, hsv2rgb", benchNanos() - start);
+    start = benchNanos();
+    for (uint32_t i = 0; i < frames; i++) {
+        gradient.render(frame, i * 5 * 256);
+        sink += packed(frame[i % LED_COUNT]);
+    }
+    double table = report("rainbow, lookup tables", benchNanos() - start);
+    printf("%-24s: %10.2fx\n", "lookup speedup", perPixel / table);
+    return ok;
+}
+
+// The thunder background variation and the sunlight flicker as they were, with random() per LED.
+// The native random() is a plain xorshift with a modulo, cheaper than the Teensy core's generator.
+static void legacyRandomLoops(uint32_t *frame, uint16_t ledCount) {
+    for (int i = 0; i < ledCount; i++) {
+        if (random(100) < 20)
+            frame[i] = packColor(0, 0, 50 + random(-15, 16));
+    }
+    for (int i = 0; i < ledCount; i++)
+        frame[i] += random(-10, 11);
+}
+
+static void fastRandomLoops(uint32_t *frame, uint16_t ledCount) {
+    static int8_t flickers[LED_COUNT];
+    for (uint16_t i = 0; i < ledCount; i++) {
+        if (effectRandom.chance(51))
+            frame[i] = packColor(0, 0, 50 + effectRandom.range(-15, 16));
+    }
+    effectRandom.fillRange(flickers, ledCount, -10, 11);
+    for (int i = 0; i < ledCount; i++)
+        frame[i] += flickers[i];
+}
+
+static bool benchRandom() {
+    bool ok = true;
+    uint64_t start = benchNanos();
+    for (uint32_t i = 0; i < frames; i++) {
+        legacyRandomLoops(packedFrame, LED_COUNT);
+        sink += packedFrame[i % LED_COUNT];
+    }
+    double legacy = report("random loops, random()", benchNanos() - start);
+    start = benchNanos();
+    for (uint32_t i = 0; i < frames; i++) {
+        fastRandomLoops(packedFrame, LED_COUNT);
+        sink += packedFrame[i % LED_COUNT];
+    }
+    double fast = report("random loops, FastRandom", benchNanos() - start);
+    printf("%-24s: %10.2fx\n", "FastRandom speedup", legacy / fast);
+
+    // The bulk fill has to keep its range, chance() its probability
+    FastRandom random(1);
+    static int8_t values[4096];
+    random.fillRange(values, 4096, -15, 16);
+    for (int i = 0; i < 4096; i++) {
+        if (values[i] < -15 || values[i] > 15) {
+            printf("fillRange value %d out of range\n", values[i]);
+            ok = false;
+            break;
+        }
+    }
+    uint32_t set = 0;
+    for (int i = 0; i < 4096; i++)
+        set += random.chance(51);
+    printf("%-24s: %10.3f (51/256 = 0.199)\n", "chance density", set / 4096.0);
+    if (set < 4096 * 0.17 || set > 4096 * 0.23)
+        ok = false;
+
+    // Same seed, same frames
+    uint32_t hashes[2];
+    for (int run = 0; run < 2; run++) {
+        seedEffects(1234);
+        hashes[run] = 0;
+        FrameClock clock;
+        for (int i = 0; i < 100; i++) {
+            sunlightEffect.render(clock.tick(i * 20000), buffer);
+            hashes[run] = FrameScheduler::hashFrame(frame, LED_COUNT, hashes[run]);
+        }
+    }
+    if (hashes[0] != hashes[1]) {
+        printf("sunlight frames differ with the same seed\n");
+        ok = false;
+    }
+    return ok;
+}
+
+// Storm statistics over 10 simulated minutes: how busy the bolt pool and the lit pixel list get
+static bool benchThunder() {
+    seedEffects(7);
+    thunderEffect.begin(buffer);
+    uint32_t maxBolts = 0;
+    uint32_t maxLit = 0;
+    uint64_t litSum = 0;
+    const uint32_t stormFrames = 10 * 60 * 50;
+    for (uint32_t i = 0; i < stormFrames; i++) {
+        nativeAdvanceMicros(thunderEffect.getFrameInterval());
+        thunderEffect.render(frameClock.tick(micros()), buffer);
+        maxBolts = max(maxBolts, (uint32_t)thunderEffect.getActiveBolts());
+        maxLit = max(maxLit, (uint32_t)thunderEffect.getLitPixels());
+        litSum += thunderEffect.getLitPixels();
+    }
+    printf("%-24s: %u bolts at once, %u lit LEDs max, %.1f on average\n", "thunder storm", maxBolts, maxLit, (double)litSum / stormFrames);
+    // Ten minutes without a single bolt would mean the spawning is broken
+    return maxBolts > 0 && maxLit <= LED_COUNT;
+}
+
+// One simulated minute at 60, 120 and 400 fps on a virtual clock must end on the same rainbow hue
+// and show the same number of sunlight flickers
+static bool benchFrameRates() {
+    static const uint16_t rates[] = {60, 120, 400};
+    uint16_t hues[3];
+    uint32_t flickers[3];
+    for (uint8_t r = 0; r < 3; r++) {
+        uint32_t interval = 1000000 / rates[r];
+        RainbowEffect rainbow;
+        FrameClock clock;
+        for (uint32_t t = 0; t < 60000000; t += interval)
+            rainbow.render(clock.tick(t), buffer);
+        // Exactly one minute for every rate
+        rainbow.render(clock.tick(60000000), buffer);
+        hues[r] = rainbow.getHue();
+
+        SunlightEffect sunlight;
+        FrameClock sunlightClock;
+        uint32_t lastHash = 0;
+        flickers[r] = 0;
+        for (uint32_t t = 0; t < 60000000; t += interval) {
+            sunlight.render(sunlightClock.tick(t), buffer);
+            uint32_t hash = FrameScheduler::hashFrame(frame, LED_COUNT);
+            if (hash != lastHash)
+                flickers[r]++;
+            lastHash = hash;
+        }
+    }
+    printf("%-24s: 60 fps %u, 120 fps %u, 400 fps %u\n", "rainbow hue after 1 min", hues[0], hues[1], hues[2]);
+    printf("%-24s: 60 fps %u, 120 fps %u, 400 fps %u\n", "sunlight flickers", flickers[0], flickers[1], flickers[2]);
+    bool ok = true;
+    if (hues[0] != hues[1] || hues[1] != hues[2]) {
+        printf("rainbow speed depends on the frame rate\n");
+        ok = false;
+    }
+    if (flickers[0] != flickers[1] || flickers[1] != flickers[2]) {
+        printf("sunlight flicker rate depends on the frame rate\n");
+        ok = false;
+    }
+
+    // A 5 s stall moves the time by maxDelta only, the same as the delta
+    FrameClock clock;
+    clock.tick(1000000);
+    clock.tick(1020000);
+    const FrameTime &stalled = clock.tick(6020000);
+    if (stalled.delta != 100000 || stalled.millis != 1120 || stalled.micros != 1120000) {
+        printf("stall moved the clock by %u ms, delta %u us\n", stalled.millis - 1000, stalled.delta);
+        ok = false;
+    }
+    return ok;
+}
+
+// Fades: the curves and the blend hit both ends exactly, a color fade lands on the new color and
+// brightness, and a thunder to rainbow crossfade costs about both effects plus one pass over the frame
+static bool benchTransition() {
+    bool ok = true;
+    for (uint8_t easing = Transition::EASE_LINEAR; easing <= Transition::EASE_IN_OUT; easing++) {
+        uint16_t last = 0;
+        for (uint32_t t = 0; t <= 65535; t += 5) {
+            uint16_t eased = Transition::ease((Transition::Easing)easing, t);
+            if (eased < last) {
+                printf("easing %u goes backwards at %u\n", easing, t);
+                ok = false;
+                break;
+            }
+            last = eased;
+        }
+        if (Transition::ease((Transition::Easing)easing, 0) != 0 || Transition::ease((Transition::Easing)easing, 65535) != 65535) {
+            printf("easing %u does not run from 0 to 65535\n", easing);
+            ok = false;
+        }
+    }
+    if (blend(CRGB(0x123456), CRGB(0xFEDCBA), 0) != CRGB(0x123456) || blend(CRGB(0x123456), CRGB(0xFEDCBA), 255) != CRGB(0xFEDCBA) ||
+        blend(CRGB::Black, CRGB::White, 128) != CRGB(0x808080)) {
+        printf("blend is off at its ends\n");
+        ok = false;
+    }
+
+    static CRGB fadeFrom[LED_COUNT];
+    static CRGB fadeTo[LED_COUNT];
+    Transition transition;
+    transition.begin(fadeFrom, fadeTo);
+    FrameClock clock;
+    uint32_t now = 0;
+
+    // One second from red at 40 to blue at 200, the color effect stays the current one
+    ColorEffect color;
+    color.setColor(packColor(255, 0, 0));
+    color.render(clock.tick(now), buffer);
+    transition.start(&color, &color, 40, 200, 1000, buffer);
+    color.setColor(packColor(0, 0, 255));
+    uint32_t halfway = 0;
+    uint8_t halfwayBrightness = 0;
+    uint16_t halfwayProgress = 0;
+    uint16_t fadeFrames = 0;
+    while (transition.render(clock.tick(now), buffer)) {
+        if (now == 500000) {
+            halfway = packed(frame[0]);
+            halfwayBrightness = transition.getBrightness();
+            halfwayProgress = transition.getProgress();
+        }
+        now += FRAME_INTERVAL_US;
+        fadeFrames++;
+    }
+    printf("%-24s: %u frames, halfway %06X at brightness %u\n", "color fade, 1 s", fadeFrames, halfway, halfwayBrightness);
+    if (frame[0] != CRGB(0, 0, 255) || frame[LED_COUNT - 1] != CRGB(0, 0, 255) || transition.getBrightness() != 200) {
+        printf("color fade ended on %06X at brightness %u\n", packed(frame[0]), transition.getBrightness());
+        ok = false;
+    }
+    if (halfwayProgress >> 8 != 127 || CRGB(halfway) != blend(CRGB(255, 0, 0), CRGB(0, 0, 255), 127) || halfwayBrightness != 120) {
+        printf("color fade is not symmetric\n");
+        ok = false;
+    }
+
+    // Out of an effect that only repaints what changed: its side goes on from the frame on the strip,
+    // not from what an earlier fade left in the from buffer
+    static CRGB shown[LED_COUNT];
+    const CRGB stale(255, 0, 255);
+    seedEffects(1);
+    thunderEffect.begin(buffer);
+    for (int i = 0; i < 200; i++) {
+        now += FRAME_INTERVAL_US;
+        thunderEffect.render(clock.tick(now), buffer);
+    }
+    memcpy(shown, frame, sizeof(frame));
+    for (CRGB &led : fadeFrom)
+        led = stale;
+    transition.start(&thunderEffect, &rainbowEffect, 150, 150, 1000, buffer);
+    now += FRAME_INTERVAL_US;
+    transition.render(clock.tick(now), buffer);
+    uint16_t staleLeds = 0;
+    for (uint16_t i = 0; i < LED_COUNT; i++)
+        staleLeds += fadeFrom[i] == stale && shown[i] != stale;
+    if (staleLeds) {
+        printf("fade out of thunder drew on an old from buffer, %u LEDs\n", staleLeds);
+        ok = false;
+    }
+    transition.cancel(buffer);
+
+    // Long enough that every frame of the bench is blended
+    seedEffects(1);
+    thunderEffect.begin(buffer);
+    transition.start(&thunderEffect, &rainbowEffect, 150, 150, 0xFFFFFFFF, buffer);
+    uint64_t start = benchNanos();
+    for (uint32_t i = 0; i < frames; i++) {
+        now += FRAME_INTERVAL_US;
+        transition.render(clock.tick(now), buffer);
+        sink += packed(frame[i % LED_COUNT]);
+    }
+    report("thunder -> rainbow fade", benchNanos() - start);
+    // Cut short, the strip has to show the incoming effect's frame and nothing of the blend
+    transition.cancel(buffer);
+    if (memcmp(frame, fadeTo, sizeof(frame)) != 0) {
+        printf("cancelled fade left the blended frame\n");
+        ok = false;
+    }
+    return ok;
+}
+
+bool benchEffects() {
+    bool ok = true;
+    colorEffect.setColor(packColor(10, 20, 30));
+    for (uint8_t mode = 0; mode < getEffectCount(); mode++)
+        benchEffect(*getEffect(mode));
+    ok &= benchThunder();
+    ok &= benchFrameRates();
+    ok &= benchTransition();
+    ok &= benchColorWheel();
+    ok &= benchRandom();
+    colorEffect.render(frameClock.get(), buffer);
+    if (frame[0] != CRGB(10, 20, 30)) {
+        printf("color mode did not fill the frame\n");
+        ok = false;
+    }
+
+    rainbowEffect.render(frameClock.get(), buffer);
+    uint64_t start = benchNanos();
+    for (uint32_t i = 0; i < frames; i++)
+        sink += FrameScheduler::hashFrame(frame, LED_COUNT, i);
+    report("stage: frame hash", benchNanos() - start);
+
+    OctoWS2811 leds(LED_COUNT, displayMemory, drawingMemory, WS2811_GRB | WS2811_800kHz, 1);
+    OutputStage output;
+    output.begin(leds, drawingMemory, LED_COUNT, WS2811_GRB | WS2811_800kHz);
+    output.setBrightness(255);
+    start = benchNanos();
+    for (uint32_t i = 0; i < frames; i++)
+        output.write(frame);
+    report("stage: output write", benchNanos() - start);
+    output.setBrightness(100);
+    uint32_t lutUpdates = output.getLutUpdates();
+    start = benchNanos();
+    for (uint32_t i = 0; i < frames; i++) {
+        output.setBrightness(100);
+        output.write(frame);
+    }
+    report("stage: write, dithered", benchNanos() - start);
+    if (output.getLutUpdates() != lutUpdates) {
+        printf("lookup table rebuilt without a brightness change\n");
+        ok = false;
+    }
+
+    // Full brightness must leave the colors untouched, only reordered to GRB
+    output.setBrightness(255);
+    output.write(frame);
+    if ((uint32_t)leds.getPixel(0) != packed(frame[0])) {
+        printf("output stage changed pixel 0: %06X != %06X\n", leds.getPixel(0), packed(frame[0]));
+        ok = false;
+    }
+
+    // Dithered over 256 frames every LED has to average its exact 8.8 level, down to the dimmest ones
+    static uint32_t sums[LED_COUNT];
+    memset(sums, 0, sizeof(sums));
+    for (uint16_t i = 0; i < LED_COUNT; i++)
+        frame[i] = CRGB(0, 0, i);
+    output.setBrightness(100);
+    for (int f = 0; f < 256; f++) {
+        output.write(frame);
+        const uint8_t *pixels = (const uint8_t *)drawingMemory;
+        for (uint16_t i = 0; i < LED_COUNT; i++)
+            sums[i] += pixels[i * 3 + 2]; // blue is the third byte in GRB
+    }
+    uint16_t visible = 0, truncated = 0;
+    for (uint16_t i = 0; i < LED_COUNT; i++) {
+        if (sums[i] != output.getLevel(i)) {
+            printf("LED %u dithered to %u/256, level is %u\n", i, sums[i], output.getLevel(i));
+            ok = false;
+            break;
+        }
+        if (sums[i] > 0)
+            visible++;
+        if (output.getLevel(i) >= 256)
+            truncated++;
+    }
+    printf("%-24s: %u of %u blue levels lit at brightness 100, %u without dithering\n", "dithering", visible, LED_COUNT, truncated);
+    if (!output.isDithering()) {
+        printf("dimmed blue ramp is not dithered\n");
+        ok = false;
+    }
+    // A frame that stays on the strip is rounded to the nearest step instead
+    output.setDithering(false);
+    output.write(frame);
+    const uint8_t *pixels = (const uint8_t *)drawingMemory;
+    for (uint16_t i = 0; i < LED_COUNT; i++) {
+        if (pixels[i * 3 + 2] != (output.getLevel(i) + 0x80) >> 8 || output.isDithering()) {
+            printf("LED %u rounded to %u, level is %u/256\n", i, pixels[i * 3 + 2], output.getLevel(i));
+            ok = false;
+            break;
+        }
+    }
+    output.setDithering(true);
+    // Only a frame with a dithered channel has to be sent again
+    memset(frame, 0, sizeof(frame));
+    output.write(frame);
+    if (output.isDithering()) {
+        printf("black frame is dithered\n");
+        ok = false;
+    }
+
+    // Host cost of the hand-off only, the wire time is simulated on the virtual clock
+    start = benchNanos();
+    for (uint32_t i = 0; i < frames; i++) {
+        nativeAdvanceMicros(FRAME_INTERVAL_US);
+        output.show();
+    }
+    report("stage: show", benchNanos() - start);
+    printf("wire time per frame     : %10u us (simulated)\n", leds.getWireTime());
+    return ok;
+}
@@ -0,0 +1,107 @@
+// Host check of the multi-pin layout: for 1 to 8 pins the strip is split evenly with every other run
+// reversed, every logical LED has to land on exactly its pixel of the OctoWS2811 drawing memory,
+// and the projected wire time per frame shrinks with the longest run.
+#include "Bench.h"
+#include "LedLayout.h"
+#include "OutputStage.h"
+#include <Arduino.h>
+#include <OctoWS2811.h>
+
+static const uint16_t MAX_LEDS = 2000;
+static const uint32_t writes = 20000;
+
+static CRGB frame[MAX_LEDS];
+// Room for 8 pins of the longest run, rounded up
+static int displayMemory[(MAX_LEDS + LED_LAYOUT_MAX_PINS) * 3 / 4 + 1];
+static int drawingMemory[(MAX_LEDS + LED_LAYOUT_MAX_PINS) * 3 / 4 + 1];
+
+// Keeps the compiler from dropping work whose result is never used
+static volatile uint32_t sink;
+
+template <uint16_t LedCount>
+static bool checkLayout(uint8_t pinCount, uint16_t &ledsPerStrip, double &writeNanos) {
+    StripRun runs[LED_LAYOUT_MAX_PINS];
+    for (uint8_t pin = 0; pin < pinCount; pin++)
+        runs[pin] = splitRun(LedCount, pinCount, pin, true);
+    LedMap<LedCount> map(runs, pinCount);
+    ledsPerStrip = map.ledsPerStrip;
+    if (!map.valid) {
+        printf("%u LEDs on %u pins: invalid layout\n", LedCount, pinCount);
+        return false;
+    }
+
+    uint32_t physicalCount = map.ledsPerStrip * pinCount;
+    memset(drawingMemory, 0, sizeof(drawingMemory));
+    OctoWS2811 leds(map.ledsPerStrip, displayMemory, drawingMemory, WS2811_GRB | WS2811_800kHz, pinCount);
+    OutputStage output;
+    output.begin(leds, drawingMemory, LedCount, WS2811_GRB | WS2811_800kHz);
+    output.setLayout(map.physical);
+    for (uint16_t i = 0; i < LedCount; i++)
+        frame[i] = CRGB((uint32_t)i + 1); // distinct and never black
+    output.write(frame);
+
+    // Every logical LED on its own pixel, and nothing written anywhere else
+    uint32_t written = 0;
+    for (uint32_t pixel = 0; pixel < physicalCount; pixel++) {
+        if (leds.getPixel(pixel) != 0)
+            written++;
+    }
+    for (uint16_t i = 0; i < LedCount; i++) {
+        if ((uint32_t)leds.getPixel(map[i]) != (uint32_t)i + 1) {
+            printf("%u LEDs on %u pins: LED %u is not on pixel %u\n", LedCount, pinCount, i, map[i]);
+            return false;
+        }
+    }
+    if (written != LedCount) {
+        printf("%u LEDs on %u pins: %u pixels written\n", LedCount, pinCount, written);
+        return false;
+    }
+    // A reversed run is connected to its last logical LED
+    if (pinCount > 1 && map[runs[1].first + runs[1].count - 1] != map.ledsPerStrip) {
+        printf("%u LEDs on %u pins: second run is not reversed\n", LedCount, pinCount);
+        return false;
+    }
+    if (leds.getWireTime() != wireTime(map.ledsPerStrip)) {
+        printf("%u LEDs on %u pins: wire time %u us, layout says %u us\n", LedCount, pinCount, leds.getWireTime(), wireTime(map.ledsPerStrip));
+        return false;
+    }
+
+    uint64_t start = benchNanos();
+    for (uint32_t i = 0; i < writes; i++) {
+        output.write(frame);
+        sink += drawingMemory[i % 16];
+    }
+    writeNanos = (double)(benchNanos() - start) / writes;
+    return true;
+}
+
+template <uint16_t LedCount>
+static bool benchPins() {
+    bool ok = true;
+    uint32_t singlePin = wireTime(LedCount);
+    printf("%u LEDs\n", LedCount);
+    for (uint8_t pins = 1; pins <= LED_LAYOUT_MAX_PINS; pins++) {
+        uint16_t ledsPerStrip = 0;
+        double writeNanos = 0;
+        ok &= checkLayout<LedCount>(pins, ledsPerStrip, writeNanos);
+        uint32_t wire = wireTime(ledsPerStrip);
+        printf("  %u pin%s: %4u LEDs per pin, wire time %5u us (%.2fx), max %6.1f fps, write %7.1f ns\n", pins, pins > 1 ? "s" : " ",
+               ledsPerStrip, wire, (double)singlePin / wire, 1000000.0 / wire, writeNanos);
+    }
+    return ok;
+}
+
+bool benchLayout() {
+    bool ok = true;
+    ok &= benchPins<247>();
+    ok &= benchPins<MAX_LEDS>();
+
+    // Broken wirings have to be caught at compile time
+    static constexpr StripRun gap[2] = {{0, 100, false}, {101, 146, false}};
+    static constexpr StripRun overlap[2] = {{0, 124, false}, {123, 124, true}};
+    static constexpr StripRun tooLong[1] = {{0, 248, false}};
+    static_assert(!LedMap<247>(gap, 2).valid, "a LED on no pin");
+    static_assert(!LedMap<247>(overlap, 2).valid, "a LED on two pins");
+    static_assert(!LedMap<247>(tooLong, 1).valid, "a run past the end");
+    return ok;
+}
@@ -0,0 +1,23 @@
+// Host benchmarks, run with
+//   pio run -e native_bench && .pio/build/native_bench/program
+#include "Bench.h"
+#include <stdio.h>
+
+int main() {
+    bool ok = true;
+    printf("== Effects and frame stages ==\n");
+    ok &= benchEffects();
+    printf("\n== Multi-pin layout ==\n");
+    ok &= benchLayout();
+    printf("\n== LED space ==\n");
+    ok &= benchSpace();
+    printf("\n== Noise ==\n");
+    ok &= benchNoise();
+    printf("\n== CRGB framebuffer ==\n");
+    ok &= benchColor();
+    printf("\n== Layer compositor ==\n");
+    ok &= benchCompositor();
+    printf("\n== ASCII message parser ==\n");
+    ok &= benchMessageParser();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+// Microbenchmark of the ASCII message parser: the table driven parseMessage() against the old
+// memmove + atoi + switch implementation of SerialHandler::parseString.
+#include "Bench.h"
+#include "MessageParser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct LampValues {
+    uint8_t r = 0;
+    uint8_t g = 0;
+    uint8_t b = 0;
+    uint8_t mode = 0;
+};
+
+struct BenchMessages {
+    static void setRed(LampValues &v, uint32_t value) { v.r = value; }
+    static void setGreen(LampValues &v, uint32_t value) { v.g = value; }
+    static void setBlue(LampValues &v, uint32_t value) { v.b = value; }
+    static void setMode(LampValues &v, uint32_t value) { v.mode = value; }
+};
+
+static constexpr MessageDescriptor<LampValues> messageTable[] = {
+    {'R', 10, 1, 3, 0, 255, &BenchMessages::setRed},
+    {'G', 10, 1, 3, 0, 255, &BenchMessages::setGreen},
+    {'B', 10, 1, 3, 0, 255, &BenchMessages::setBlue},
+    {'M', 10, 1, 3, 0, 255, &BenchMessages::setMode},
+};
+
+// The previous SerialHandler::parseString
+static void legacyParse(LampValues &v, char *string) {
+    char messageType = string[0];
+    memmove(string, string + 1, strlen(string));
+    switch (messageType) {
+    case 'R':
+        v.r = atoi(string);
+        break;
+    case 'G':
+        v.g = atoi(string);
+        break;
+    case 'B':
+        v.b = atoi(string);
+        break;
+    case 'M':
+        v.mode = atoi(string);
+        break;
+    }
+}
+
+static const char *messages[] = {"R255", "G128", "B7", "M2", "R0", "G64", "B200", "M0"};
+static const int messageCount = sizeof(messages) / sizeof(messages[0]);
+static const long iterations = 5000000;
+
+bool benchMessageParser() {
+    LampValues values;
+    char buffer[16];
+    uint8_t lengths[messageCount];
+    for (int i = 0; i < messageCount; i++)
+        lengths[i] = strlen(messages[i]);
+
+    uint64_t start = benchNanos();
+    for (long i = 0; i < iterations; i++) {
+        // The receiver copies every message into its buffer before parsing, do the same here
+        int m = i % messageCount;
+        memcpy(buffer, messages[m], lengths[m] + 1);
+        legacyParse(values, buffer);
+    }
+    double legacySeconds = (benchNanos() - start) / 1e9;
+    uint32_t legacyCheck = values.r + values.g + values.b + values.mode;
+
+    values = LampValues();
+    start = benchNanos();
+    for (long i = 0; i < iterations; i++) {
+        int m = i % messageCount;
+        memcpy(buffer, messages[m], lengths[m] + 1);
+        parseMessage(messageTable, values, buffer, lengths[m]);
+    }
+    double tableSeconds = (benchNanos() - start) / 1e9;
+    uint32_t tableCheck = values.r + values.g + values.b + values.mode;
+
+    printf("legacy parseString : %8.2f M messages/s\n", iterations / legacySeconds / 1e6);
+    printf("parseMessage table : %8.2f M messages/s (%.2fx)\n", iterations / tableSeconds / 1e6, legacySeconds / tableSeconds);
+    if (legacyCheck != tableCheck) {
+        printf("Result mismatch: %u != %u\n", legacyCheck, tableCheck);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,148 @@
+// Host check of the noise kernel and the cloud effect: the plain lerp against a model of the SMUAD the
+// Cortex-M7 build uses for it, for every input, the shape of the noise (full range, no steps, no seam
+// where the coordinates wrap), and the cost of a cloud frame for 247 and 2000 LEDs against the frame budget.
+#include "Bench.h"
+#include "Effects.h"
+#include "FrameClock.h"
+#include "LedPositions.h"
+#include "LedSpace.h"
+#include "Noise.h"
+#include <Arduino.h>
+
+static const uint32_t FRAME_BUDGET_US = 20000;
+// Host timings have to stay well inside the budget, the lamp's core is several times slower
+static const uint32_t HOST_BUDGET_PERCENT = 5;
+static const uint32_t frames = 5000;
+
+// 40 rows of 50 LEDs over the whole cube
+static const uint16_t PANEL_LED_COUNT = 2000;
+constexpr LedPoint panelPosition(uint16_t led) { return {(uint8_t)(led % 50 * 5), (uint8_t)(led / 50 * 6), 0}; }
+
+// Keeps the compiler from dropping work whose result is never used
+static volatile uint32_t sink;
+
+// SMUAD: both signed halfword products, added
+static uint32_t smuadModel(uint32_t x, uint32_t y) {
+    return (int32_t)(int16_t)x * (int16_t)y + (int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16);
+}
+
+static bool checkLerp() {
+    for (uint32_t fraction = 0; fraction <= 256; fraction++) {
+        uint32_t weights = noiseWeights(fraction);
+        for (uint32_t a = 0; a < 256; a++) {
+            for (uint32_t b = 0; b < 256; b++) {
+                uint8_t model = smuadModel(a | (b << 16), weights) >> 8;
+                uint8_t lerp = noiseLerp(a, b, weights);
+                if (lerp != model) {
+                    printf("lerp %u -> %u at %u: %u, SMUAD gives %u\n", a, b, fraction, lerp, model);
+                    return false;
+                }
+            }
+        }
+    }
+    printf("lerp matches SMUAD for all %u inputs (%s build)\n", 256 * 256 * 257, NOISE_DSP ? "DSP" : "portable");
+    return true;
+}
+
+static bool checkShape() {
+    bool ok = true;
+    uint8_t low = 255, high = 0;
+    uint8_t steepest = 0;
+    uint32_t seam = 0;
+    for (uint32_t z = 0; z < 0x10000; z += 0x0C35) {
+        for (uint32_t y = 0; y < 0x10000; y += 0x0B1D) {
+            uint8_t previous = noise3(0xFFFF, y, z);
+            for (uint32_t x = 0; x < 0x10000; x += 4) {
+                uint8_t value = noise3(x, y, z);
+                low = min(low, value);
+                high = max(high, value);
+                steepest = max(steepest, (uint8_t)abs(value - previous));
+                if (x == 0)
+                    seam = max(seam, (uint32_t)abs(value - previous));
+                previous = value;
+            }
+        }
+    }
+    printf("noise3: values %u..%u, largest step between neighbours 4/256 apart %u, at the wrap %u\n", low, high, steepest, seam);
+    // Smoothstep slope is at most 1.5, a step of 4/256 cell moves at most 6/256 of the full range
+    if (low > 16 || high < 239 || steepest > 8 || seam > 8) {
+        printf("noise3 is not a smooth full-range noise\n");
+        ok = false;
+    }
+    // Same coordinates, same value: no state anywhere
+    if (noise3(0x1234, 0x5678, 0x9ABC) != noise3(0x1234, 0x5678, 0x9ABC) || fractalNoise3(1, 2, 3) != fractalNoise3(1, 2, 3))
+        ok = false;
+    return ok;
+}
+
+static uint64_t kernelNanos(uint32_t samples) {
+    uint32_t sum = 0;
+    uint64_t start = benchNanos();
+    for (uint32_t i = 0; i < samples; i++)
+        sum += fractalNoise3(i * 97, i * 31, i >> 4);
+    uint64_t took = benchNanos() - start;
+    sink += sum;
+    return took;
+}
+
+// Average and worst time per cloud frame, in its share of the frame budget
+static bool benchClouds(const char *name, LedBuffer &buffer, const LedSpace *space) {
+    FrameClock clock;
+    cloudEffect.setSpace(space);
+    cloudEffect.begin(buffer);
+    uint64_t elapsed = 0;
+    uint64_t worst = 0;
+    uint32_t now = 0;
+    for (uint32_t i = 0; i < frames; i++) {
+        now += cloudEffect.getFrameInterval();
+        uint64_t start = benchNanos();
+        cloudEffect.render(clock.tick(now), buffer);
+        uint64_t took = benchNanos() - start;
+        elapsed += took;
+        worst = max(worst, took);
+        sink += buffer.pixels[i % buffer.count].b;
+    }
+    cloudEffect.end();
+    cloudEffect.setSpace(nullptr);
+    double perFrame = (double)elapsed / frames;
+    double share = perFrame / (FRAME_BUDGET_US * 10.0);
+    printf("%-24s: %10.1f ns/frame, %5.1f ns/LED, worst %llu ns, %.2f%% of the frame budget\n", name, perFrame, perFrame / buffer.count,
+           (unsigned long long)worst, share);
+    if (share > HOST_BUDGET_PERCENT) {
+        printf("%s takes more than %u%% of the frame budget on the host\n", name, HOST_BUDGET_PERCENT);
+        return false;
+    }
+    return true;
+}
+
+bool benchNoise() {
+    bool ok = true;
+    ok &= checkLerp();
+    ok &= checkShape();
+
+    const uint32_t samples = 1000000;
+    printf("fractalNoise3           : %10.1f ns/sample\n", (double)kernelNanos(samples) / samples);
+
+    static constexpr LedSpaceTable<CLOUD_LED_COUNT> cloudTable(cloudPosition);
+    static constexpr LedSpaceTable<PANEL_LED_COUNT> panelTable(panelPosition);
+    const LedSpace cloud(cloudTable);
+    const LedSpace panel(panelTable);
+    static CRGB pixels[PANEL_LED_COUNT];
+    LedBuffer small = {pixels, CLOUD_LED_COUNT};
+    LedBuffer large = {pixels, PANEL_LED_COUNT};
+    ok &= benchClouds("clouds, 247 on the strip", small, nullptr);
+    ok &= benchClouds("clouds, 247 in the cloud", small, &cloud);
+    ok &= benchClouds("clouds, 2000 on a strip", large, nullptr);
+    ok &= benchClouds("clouds, 2000 on a panel", large, &panel);
+
+    // The sky has to show both: some LEDs clear, some under a cloud
+    uint16_t clear = 0, cloudy = 0;
+    for (uint16_t i = 0; i < PANEL_LED_COUNT; i++) {
+        clear += pixels[i].r < 0x40;
+        cloudy += pixels[i].r > 0xC0;
+    }
+    printf("last panel frame: %u LEDs clear sky, %u under a cloud\n", clear, cloudy);
+    if (clear == 0 || cloudy == 0)
+        ok = false;
+    return ok;
+}
@@ -0,0 +1,130 @@
+// Host check of the LED space: radius queries against a brute force scan over every LED, for the
+// lamp's own layout and for 2000 LEDs scattered through the cube, the cost of a query, and the
+// thunder and rainbow effects rendering across the cloud instead of along the strip.
+#include "Bench.h"
+#include "Effects.h"
+#include "FrameClock.h"
+#include "LedPositions.h"
+#include "LedSpace.h"
+#include <Arduino.h>
+
+static const uint16_t SCATTER_COUNT = 2000;
+static const uint32_t queries = 20000;
+static const uint32_t frames = 20000;
+
+static LedPoint scattered[SCATTER_COUNT];
+static LedPoint scatteredPosition(uint16_t led) { return scattered[led]; }
+
+// Keeps the compiler from dropping work whose result is never used
+static volatile uint32_t sink;
+
+static uint32_t bruteForceWithin(const LedSpace &space, const LedPoint &center, uint8_t radius, uint8_t *found) {
+    uint32_t count = 0;
+    for (uint16_t led = 0; led < space.getCount(); led++) {
+        const LedPoint &p = space.getPoint(led);
+        int32_t dx = p.x - center.x;
+        int32_t dy = p.y - center.y;
+        int32_t dz = p.z - center.z;
+        found[led] = dx * dx + dy * dy + dz * dz <= radius * radius;
+        count += found[led];
+    }
+    return count;
+}
+
+static bool benchQueries(const char *name, const LedSpace &space) {
+    static uint8_t expected[SCATTER_COUNT];
+    static uint8_t seen[SCATTER_COUNT];
+    FastRandom random(3);
+    bool ok = true;
+
+    // The grid has to find exactly the LEDs a full scan finds, each of them once
+    for (uint32_t q = 0; q < 2000 && ok; q++) {
+        LedPoint center = {(uint8_t)random.below(256), (uint8_t)random.below(256), (uint8_t)random.below(256)};
+        uint8_t radius = random.range(1, 100);
+        uint32_t count = bruteForceWithin(space, center, radius, expected);
+        memset(seen, 0, sizeof(seen));
+        uint32_t visited = 0;
+        space.forEachWithin(center, radius, [&](uint16_t led, uint16_t) {
+            if (!expected[led] || seen[led]++)
+                ok = false;
+            visited++;
+        });
+        if (visited != count)
+            ok = false;
+        if (!ok)
+            printf("%s: query at %u,%u,%u r %u found %u LEDs, a full scan %u\n", name, center.x, center.y, center.z, radius, visited, count);
+    }
+
+    static const uint8_t radii[] = {16, 32, 64};
+    for (uint8_t r = 0; r < sizeof(radii); r++) {
+        uint64_t found = 0;
+        uint64_t start = benchNanos();
+        for (uint32_t q = 0; q < queries; q++) {
+            // Queries around LEDs, the way the thunder effect places its bolts
+            const LedPoint &center = space.getPoint(q * 7919 % space.getCount());
+            space.forEachWithin(center, radii[r], [&](uint16_t led, uint16_t distanceSquared) {
+                sink += led + distanceSquared;
+                found++;
+            });
+        }
+        double gridNanos = (double)(benchNanos() - start) / queries;
+        start = benchNanos();
+        for (uint32_t q = 0; q < queries / 10; q++)
+            sink += bruteForceWithin(space, space.getPoint(q * 7919 % space.getCount()), radii[r], expected);
+        double scanNanos = (double)(benchNanos() - start) / (queries / 10);
+        printf("%-16s r %2u: %6.1f LEDs, grid %7.1f ns, full scan %8.1f ns (%.1fx)\n", name, radii[r], (double)found / queries, gridNanos,
+               scanNanos, scanNanos / gridNanos);
+    }
+    return ok;
+}
+
+// Average and worst time per frame of an effect across the cloud
+static void benchSpatialEffect(const char *name, Effect &effect, LedBuffer &buffer) {
+    FrameClock clock;
+    seedEffects(1);
+    effect.begin(buffer);
+    uint64_t elapsed = 0;
+    uint64_t worst = 0;
+    uint32_t now = 0;
+    for (uint32_t i = 0; i < frames; i++) {
+        now += effect.getFrameInterval();
+        uint64_t start = benchNanos();
+        effect.render(clock.tick(now), buffer);
+        uint64_t took = benchNanos() - start;
+        elapsed += took;
+        worst = max(worst, took);
+        sink += buffer.pixels[i % buffer.count].b;
+    }
+    effect.end();
+    printf("%-24s: %10.1f ns/frame, worst %llu ns\n", name, (double)elapsed / frames, (unsigned long long)worst);
+}
+
+bool benchSpace() {
+    bool ok = true;
+    static constexpr LedSpaceTable<CLOUD_LED_COUNT> cloudTable(cloudPosition);
+    const LedSpace cloud(cloudTable);
+    FastRandom random(5);
+    for (uint16_t led = 0; led < SCATTER_COUNT; led++)
+        scattered[led] = {(uint8_t)random.below(256), (uint8_t)random.below(256), (uint8_t)random.below(256)};
+    static LedSpaceTable<SCATTER_COUNT> scatterTable(scatteredPosition);
+    const LedSpace scatter(scatterTable);
+
+    ok &= benchQueries("cloud, 247", cloud);
+    ok &= benchQueries("scattered, 2000", scatter);
+
+    static CRGB pixels[CLOUD_LED_COUNT];
+    LedBuffer buffer = {pixels, CLOUD_LED_COUNT};
+    thunderEffect.setSpace(&cloud);
+    rainbowEffect.setSpace(&cloud);
+    benchSpatialEffect("thunder across the cloud", thunderEffect, buffer);
+    benchSpatialEffect("rainbow across the cloud", rainbowEffect, buffer);
+
+    // The rainbow has to run along x: LEDs above each other share a color, the ends of a row do not
+    if (pixels[0] == pixels[CLOUD_COLUMNS - 1] || pixels[0] != pixels[2 * CLOUD_COLUMNS - 1]) {
+        printf("rainbow does not follow x\n");
+        ok = false;
+    }
+    thunderEffect.setSpace(nullptr);
+    rainbowEffect.setSpace(nullptr);
+    return ok;
+}
@@ -0,0 +1,42 @@
+/*"""
+
+ LED Positions:
+ Where the LEDs of this lamp sit, as a compile-time function for LedSpaceTable (see LedSpace.h).
+ Units are about 4 mm, x runs along the cloud, y across it and z up.
+
+ The strip is modelled as 13 rows of 19 LEDs, snaking back and forth over the base, lifted into a dome
+ towards the middle of the cloud. Measured positions can replace it one to one:
+   constexpr LedPoint measured[LED_COUNT] = {{0, 0, 0}, ...};
+   constexpr LedPoint cloudPosition(uint16_t led) { return measured[led]; }
+
+"""*/
+#ifndef LedPositions_H
+#define LedPositions_H
+#include "LedSpace.h"
+#include <inttypes.h>
+
+static const uint8_t CLOUD_ROWS = 13;
+static const uint8_t CLOUD_COLUMNS = 19;
+static const uint16_t CLOUD_LED_COUNT = CLOUD_ROWS * CLOUD_COLUMNS;
+static const uint8_t CLOUD_COLUMN_SPACING = 13;
+static const uint8_t CLOUD_ROW_SPACING = 18;
+static const uint8_t CLOUD_DOME_HEIGHT = 100;
+
+constexpr LedPoint cloudPosition(uint16_t led) {
+    uint8_t row = led / CLOUD_COLUMNS;
+    uint8_t column = led % CLOUD_COLUMNS;
+    // Every other row runs back
+    if (row & 1)
+        column = CLOUD_COLUMNS - 1 - column;
+    int32_t x = column * CLOUD_COLUMN_SPACING;
+    int32_t y = row * CLOUD_ROW_SPACING;
+    // Elliptic dome over the base, flat where it would dip below it
+    int32_t halfLength = (CLOUD_COLUMNS - 1) * CLOUD_COLUMN_SPACING / 2;
+    int32_t halfWidth = (CLOUD_ROWS - 1) * CLOUD_ROW_SPACING / 2;
+    int32_t dx = x - halfLength;
+    int32_t dy = y - halfWidth;
+    int32_t z = CLOUD_DOME_HEIGHT - CLOUD_DOME_HEIGHT * dx * dx / (halfLength * halfLength) - CLOUD_DOME_HEIGHT * dy * dy / (halfWidth * halfWidth);
+    return {(uint8_t)x, (uint8_t)y, (uint8_t)(z > 0 ? z : 0)};
+}
+
+#endif
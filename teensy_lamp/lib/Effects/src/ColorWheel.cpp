@@ -0,0 +1,31 @@
+#include "ColorWheel.h"
+
+// The only divisions, once per LED count instead of once per pixel and frame
+void HueGradient::begin(uint16_t ledCount) {
+    if (ledCount > EFFECTS_MAX_LEDS)
+        ledCount = EFFECTS_MAX_LEDS;
+    _ledCount = ledCount;
+    for (uint16_t i = 0; i < ledCount; i++)
+        _offsets[i] = (uint32_t)i * 256 / ledCount;
+}
+
+void HueGradient::render(CRGB *frame, uint16_t hue) const {
+    const CRGB *wheel = rainbowWheel();
+    uint8_t base = hue >> 8;
+    for (uint16_t i = 0; i < _ledCount; i++)
+        frame[i] = wheel[(uint8_t)(base + _offsets[i])];
+}
+
+// Same gradient, laid across the lamp from its lowest to its highest x
+void HueGradient::begin(const LedSpace &space) {
+    uint16_t ledCount = min(space.getCount(), (uint16_t)EFFECTS_MAX_LEDS);
+    uint8_t low = 255;
+    uint8_t high = 0;
+    for (uint16_t i = 0; i < ledCount; i++) {
+        low = min(low, space.getPoint(i).x);
+        high = max(high, space.getPoint(i).x);
+    }
+    _ledCount = ledCount;
+    for (uint16_t i = 0; i < ledCount; i++)
+        _offsets[i] = (uint32_t)(space.getPoint(i).x - low) * 256 / (high - low + 1);
+}
@@ -0,0 +1,119 @@
+/*"""
+
+ Compositor:
+ A fixed stack of layers blended bottom to top into the framebuffer, so an overlay (a brightness bar,
+ lightning) can sit on top of any effect without the effect knowing about it or being rendered again.
+
+ Every layer has its own buffer and a blend mode:
+   BLEND_REPLACE  the layer's colors, whatever is below
+   BLEND_ADD      added channel by channel, saturating
+   BLEND_ALPHA    mixed over what is below by the layer's alpha buffer (or its opacity alone)
+   BLEND_MAX      the brighter of both per channel
+ and is either driven by an effect, rendered by the compositor, or drawn by hand by the caller.
+
+ Each layer tracks the LEDs that changed since the last composite as one range. Effects report theirs
+ through Effect::getChanged(), hand-drawn layers call markDirty(). Only the union of those ranges is
+ blended again, through all enabled layers; the rest of the framebuffer keeps its last result.
+
+   Compositor compositor;
+   compositor.begin(buffer);
+   compositor.getLayer(0).begin(basePixels, BLEND_REPLACE);
+   compositor.getLayer(0).setEffect(&sunlightEffect);
+   compositor.getLayer(1).begin(barPixels, BLEND_ALPHA, barAlpha);
+   ...
+   compositor.render(frameClock.tick());          // once per frame, true if the framebuffer changed
+
+"""*/
+#ifndef Compositor_H
+#define Compositor_H
+#include "Effect.h"
+#include "FastLED.h"
+#include <inttypes.h>
+
+enum BlendMode : uint8_t {
+    BLEND_REPLACE,
+    BLEND_ADD,
+    BLEND_ALPHA,
+    BLEND_MAX,
+};
+
+// LEDs [first, end) that need blending again, empty when first == end
+struct DirtyRange {
+    uint16_t first = 0;
+    uint16_t end = 0;
+
+    bool isEmpty() const { return first >= end; }
+    void add(uint16_t addFirst, uint16_t addEnd) {
+        if (addFirst >= addEnd)
+            return;
+        if (isEmpty()) {
+            first = addFirst;
+            end = addEnd;
+            return;
+        }
+        first = min(first, addFirst);
+        end = max(end, addEnd);
+    }
+    void clear() { first = end = 0; }
+};
+
+class Layer {
+public:
+    // pixels (and alpha, if given) hold one entry per LED of the compositor's buffer
+    void begin(CRGB *pixels, BlendMode mode, uint8_t *alpha = nullptr);
+    // Render the layer with an effect from now on, nullptr to draw it by hand
+    void setEffect(Effect *effect);
+    void setEnabled(bool enabled);
+    void setMode(BlendMode mode);
+    // Scales the whole layer for add, alpha and max
+    void setOpacity(uint8_t opacity);
+    // The caller changed LEDs [first, end) of a hand-drawn layer
+    void markDirty(uint16_t first, uint16_t end) { _dirty.add(first, end); }
+    void markDirty() { _dirty.add(0, _count); }
+
+    CRGB *getPixels() { return _pixels; }
+    uint8_t *getAlpha() { return _alpha; }
+    Effect *getEffect() const { return _effect; }
+    bool isEnabled() const { return _enabled; }
+    BlendMode getMode() const { return _mode; }
+    const DirtyRange &getDirty() const { return _dirty; }
+
+private:
+    friend class Compositor;
+    void _blend(CRGB *out, uint16_t first, uint16_t end) const;
+
+    CRGB *_pixels = nullptr;
+    uint8_t *_alpha = nullptr;
+    uint16_t _count = 0;
+    Effect *_effect = nullptr;
+    BlendMode _mode = BLEND_REPLACE;
+    uint8_t _opacity = 255;
+    bool _enabled = false;
+    DirtyRange _dirty;
+};
+
+class Compositor {
+public:
+    static const uint8_t maxLayers = 4;
+
+    void begin(LedBuffer &buffer);
+    // 0 is the bottom of the stack
+    Layer &getLayer(uint8_t index) { return _layers[index]; }
+    // Render the layers' effects and blend the dirty range into the framebuffer.
+    // Returns true if any LED of the framebuffer was blended again.
+    bool render(const FrameTime &time);
+    // Blend every LED again, e.g. after the framebuffer was used for something else
+    void markDirty();
+
+    // LEDs blended by the last render(), and by all of them
+    uint16_t getBlended() const { return _blended; }
+    uint32_t getTotalBlended() const { return _totalBlended; }
+
+private:
+    Layer _layers[maxLayers];
+    LedBuffer _buffer = {nullptr, 0};
+    uint16_t _blended = 0;
+    uint32_t _totalBlended = 0;
+};
+
+#endif
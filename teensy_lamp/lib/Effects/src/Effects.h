@@ -0,0 +1,201 @@
+/*"""
+
+ Effects:
+ Every effect renders one frame into a logical CRGB framebuffer per call, with FastLED's 8-bit color math
+ (scale8, blend, hsv2rgb) instead of unpacking channels by hand. Brightness is not applied here, that is done
+ by the output stage. Effects keep their state between calls (and may rely on the previous contents of the
+ framebuffer), so always pass the same buffer.
+ Randomness comes from effectRandom, a fixed seed (seedEffects()) gives the same frames on every run.
+
+ All effects are preallocated and listed in a registry indexed by the lamp mode:
+   0 thunder, 1 sunlight, 2 rainbow, 3 color, 4 clouds
+ Adding an effect is a class here and an entry in the registry in Effects.cpp.
+
+ Thunder and rainbow work along the strip by default. Given the LED positions (setSpace(), see LedSpace.h)
+ they work across the physical lamp instead: bolts light spheres around a point, the rainbow runs along x,
+ the clouds drift over the lamp seen from above.
+
+"""*/
+#ifndef Effects_H
+#define Effects_H
+#include "Arduino.h"
+#include "ColorWheel.h"
+#include "Effect.h"
+#include "FastRandom.h"
+#include "LedSpace.h"
+#include "Noise.h"
+#include <inttypes.h>
+
+// Random source of all effects
+extern FastRandom effectRandom;
+void seedEffects(uint32_t seed);
+
+// Same packing as OctoWS2811::Color() and CRGB's color codes, how colors arrive from the protocol
+constexpr uint32_t packColor(uint8_t r, uint8_t g, uint8_t b) { return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b; }
+
+uint32_t Wheel(byte WheelPos);
+
+// Lightning over a shimmering blue background. Up to maxBolts bolts are active at once, each a few
+// flashes on one stretch of the strip plus up to two dimmer branches next to it. Light is accumulated
+// per LED in 8.8 fixed point and decays exponentially with the elapsed time: fast while bright, then
+// a slow afterglow. Only lit LEDs and the few re-rolled background LEDs are touched per frame.
+// Every bolt has its own color, a LED shows the one of the bolt that lit it brightest, and a bolt's slot
+// is only reused once its afterglow is gone.
+// With a space a segment is a sphere around a point instead of a stretch, fading out towards its edge.
+// Without the background only the lightning is drawn, over black, e.g. as a layer over another effect.
+class ThunderEffect : public Effect {
+public:
+    static const uint8_t maxBolts = 4;
+    static const uint8_t maxSegments = 3;
+
+    const char *getName() const override { return "thunder"; }
+    void begin(LedBuffer &buffer) override;
+    void render(const FrameTime &time, LedBuffer &buffer) override;
+    // Set before begin(), nullptr to go back to the strip
+    void setSpace(const LedSpace *space) { _space = space; }
+    // Set before begin()
+    void setBackground(bool shown);
+    void getChanged(uint16_t count, uint16_t &first, uint16_t &end) const override;
+    uint8_t getActiveBolts() const;
+    uint16_t getLitPixels() const { return _litCount; }
+
+private:
+    struct Segment {
+        uint16_t start;
+        uint16_t length;
+        uint16_t level; // 8.8
+        LedPoint center; // with a space
+        uint8_t radius;
+    };
+    struct Bolt {
+        Segment segments[maxSegments];
+        uint8_t segmentCount;
+        uint8_t flashesLeft; // 0 = done flashing
+        bool on;
+        uint32_t nextTime;
+        CRGB color;
+        uint16_t litLeds; // LEDs still glowing in its color, free once done flashing and 0
+    };
+
+    void _spawn(uint32_t now, uint16_t ledCount);
+    void _spawnInSpace(Bolt &bolt);
+    void _updateBolt(uint8_t index, uint32_t now);
+    void _light(uint16_t led, uint16_t level, uint8_t bolt);
+    inline void _changed(uint16_t led) {
+        _changedFirst = min(_changedFirst, led);
+        _changedEnd = max(_changedEnd, (uint16_t)(led + 1));
+    }
+    void _decay(uint32_t elapsed, LedBuffer &buffer);
+    void _shimmer(uint32_t elapsed, LedBuffer &buffer);
+
+    Bolt _bolts[maxBolts] = {};
+    const LedSpace *_space = nullptr;
+    uint32_t _nextSpawnTime = 0;
+    uint32_t _shimmerCarry = 0;
+    uint16_t _ledCount = 0;
+    uint16_t _changedFirst = 0;
+    uint16_t _changedEnd = 0;
+    bool _started = false;
+    bool _backgroundShown = true;
+
+    uint8_t _background[EFFECTS_MAX_LEDS]; // blue level of every LED
+    uint16_t _glow[EFFECTS_MAX_LEDS];      // lightning intensity, 8.8
+    uint8_t _source[EFFECTS_MAX_LEDS];     // bolt whose color a glowing LED shows
+    uint16_t _lit[EFFECTS_MAX_LEDS];       // LEDs with a glow, unordered
+    uint16_t _litCount = 0;
+};
+
+// Flickering warm light, a new flicker every flickerPeriod ms whatever the frame rate
+class SunlightEffect : public Effect {
+public:
+    static const uint32_t flickerPeriod = 20;
+
+    const char *getName() const override { return "sunlight"; }
+    // A layer's buffer starts out empty, flicker right away
+    void begin(LedBuffer &buffer) override { _started = false; }
+    void render(const FrameTime &time, LedBuffer &buffer) override;
+    void setColor(uint32_t color) { _color = color; }
+    // Everything on a new flicker, nothing in between
+    void getChanged(uint16_t count, uint16_t &first, uint16_t &end) const override {
+        first = 0;
+        end = _flickered ? min(count, (uint16_t)EFFECTS_MAX_LEDS) : 0;
+    }
+
+private:
+    CRGB _color = CRGB(255, 128, 0);
+    uint32_t _nextFlickerTime = 0;
+    bool _started = false;
+    bool _flickered = false;
+    int8_t _flickers[EFFECTS_MAX_LEDS];
+};
+
+class RainbowEffect : public Effect {
+public:
+    const char *getName() const override { return "rainbow"; }
+    void render(const FrameTime &time, LedBuffer &buffer) override;
+    // Speed of the rainbow transition in 1/256 hue steps per second
+    void setSpeed(uint32_t speed) { _speed = speed; }
+    // One turn of the color wheel across the lamp along x, nullptr for along the strip
+    void setSpace(const LedSpace *space);
+    uint16_t getHue() const { return _hue; }
+
+private:
+    HueGradient _gradient;
+    const LedSpace *_space = nullptr;
+    uint16_t _hue = 0; // Current hue value for the rainbow effect, 8.8 fixed point
+    uint32_t _hueRemainder = 0;
+    uint32_t _speed = 5 * 50 * 256; // 5 steps per frame at 50 fps
+};
+
+// Plain color, static until the color changes so the render loop can skip it
+class ColorEffect : public Effect {
+public:
+    const char *getName() const override { return "color"; }
+    void render(const FrameTime &time, LedBuffer &buffer) override;
+    bool isStatic() const override { return true; }
+    void setColor(uint32_t color);
+
+private:
+    CRGB _color = CRGB::Black;
+};
+
+// Clouds drifting over the sky: fractal noise (see Noise.h) of every LED's position, with time as the third
+// axis, mapped from sky to cloud color. The noise drifts along x and slowly changes its shape. No per-LED
+// state, every frame is a pure function of the positions and the two time offsets.
+class CloudEffect : public Effect {
+public:
+    CloudEffect() { setColors(packColor(10, 40, 140), packColor(230, 230, 220)); }
+
+    const char *getName() const override { return "clouds"; }
+    void render(const FrameTime &time, LedBuffer &buffer) override;
+    // Noise over x/y of the lamp, nullptr for along the strip
+    void setSpace(const LedSpace *space) { _space = space; }
+    void setColors(uint32_t sky, uint32_t cloud);
+    // Speeds in 1/256 noise cells per second: drift along x, change of shape
+    void setSpeed(uint32_t drift, uint32_t churn) {
+        _driftSpeed = drift;
+        _churnSpeed = churn;
+    }
+
+private:
+    const LedSpace *_space = nullptr;
+    CRGB _palette[256]; // by noise value
+    uint16_t _drift = 0;    // 8.8 noise coordinates, wrap around with the noise
+    uint16_t _churn = 0;
+    uint32_t _driftRemainder = 0;
+    uint32_t _churnRemainder = 0;
+    uint32_t _driftSpeed = 40;
+    uint32_t _churnSpeed = 48;
+};
+
+extern ThunderEffect thunderEffect;
+extern SunlightEffect sunlightEffect;
+extern RainbowEffect rainbowEffect;
+extern ColorEffect colorEffect;
+extern CloudEffect cloudEffect;
+
+// Effect for a lamp mode, nullptr if there is none
+Effect *getEffect(uint8_t mode);
+uint8_t getEffectCount();
+
+#endif
@@ -0,0 +1,108 @@
+/*"""
+
+ LED Space:
+ Where every LED of the strip sits in the lamp, so effects can work across the physical cloud instead of
+ along the wiring. Positions are 8-bit x/y/z in one common unit, the lamp fits into the 0..255 cube.
+
+ LedSpaceTable is generated at compile time from a constexpr position function. Next to the positions it
+ holds a uniform grid of 8 x 8 x 8 cells with the LEDs sorted by cell, so "every LED within r of p" only
+ visits the cells the sphere overlaps: O(k) for k LEDs found plus at most a few dozen cells.
+
+   constexpr LedPoint position(uint16_t led) { ... }
+   static constexpr LedSpaceTable<LED_COUNT> table PROGMEM = LedSpaceTable<LED_COUNT>(position);
+   static const LedSpace space(table);
+   space.forEachWithin(center, 40, [&](uint16_t led, uint16_t distanceSquared) { ... });
+
+ LedSpace is only a view on the table and can be passed to the effects (setSpace()).
+
+"""*/
+#ifndef LedSpace_H
+#define LedSpace_H
+#include <inttypes.h>
+
+struct LedPoint {
+    uint8_t x;
+    uint8_t y;
+    uint8_t z;
+};
+
+// Grid cells of 32 units, 8 per axis
+static const uint8_t LED_SPACE_CELL_BITS = 5;
+static const uint8_t LED_SPACE_CELLS = 256 >> LED_SPACE_CELL_BITS;
+static const uint16_t LED_SPACE_CELL_COUNT = LED_SPACE_CELLS * LED_SPACE_CELLS * LED_SPACE_CELLS;
+
+constexpr uint16_t ledSpaceCell(uint8_t x, uint8_t y, uint8_t z) {
+    return (x >> LED_SPACE_CELL_BITS) | ((y >> LED_SPACE_CELL_BITS) << 3) | ((z >> LED_SPACE_CELL_BITS) << 6);
+}
+
+template <uint16_t LedCount>
+struct LedSpaceTable {
+    LedPoint points[LedCount];                  // by LED
+    uint16_t cellStart[LED_SPACE_CELL_COUNT + 1]; // first entry of every cell in cellLeds/cellPoints
+    uint16_t cellLeds[LedCount];                // LEDs sorted by cell
+    LedPoint cellPoints[LedCount];              // their positions, in the same order
+
+    constexpr LedSpaceTable(LedPoint (*position)(uint16_t)) : points(), cellStart(), cellLeds(), cellPoints() {
+        // Counting sort by cell, LEDs of one cell keep their strip order
+        for (uint16_t led = 0; led < LedCount; led++) {
+            points[led] = position(led);
+            cellStart[ledSpaceCell(points[led].x, points[led].y, points[led].z) + 1]++;
+        }
+        for (uint16_t cell = 0; cell < LED_SPACE_CELL_COUNT; cell++)
+            cellStart[cell + 1] += cellStart[cell];
+        uint16_t filled[LED_SPACE_CELL_COUNT] = {};
+        for (uint16_t led = 0; led < LedCount; led++) {
+            uint16_t cell = ledSpaceCell(points[led].x, points[led].y, points[led].z);
+            uint16_t slot = cellStart[cell] + filled[cell]++;
+            cellLeds[slot] = led;
+            cellPoints[slot] = points[led];
+        }
+    }
+};
+
+class LedSpace {
+public:
+    template <uint16_t LedCount>
+    constexpr LedSpace(const LedSpaceTable<LedCount> &table)
+        : _points(table.points), _cellStart(table.cellStart), _cellLeds(table.cellLeds), _cellPoints(table.cellPoints), _count(LedCount) {}
+
+    uint16_t getCount() const { return _count; }
+    const LedPoint &getPoint(uint16_t led) const { return _points[led]; }
+
+    // Call visit(led, distanceSquared) for every LED at most radius away from center, in no particular order
+    template <typename Visitor>
+    void forEachWithin(const LedPoint &center, uint8_t radius, Visitor visit) const {
+        uint8_t x0 = center.x > radius ? center.x - radius : 0;
+        uint8_t y0 = center.y > radius ? center.y - radius : 0;
+        uint8_t z0 = center.z > radius ? center.z - radius : 0;
+        uint8_t x1 = center.x < 255 - radius ? center.x + radius : 255;
+        uint8_t y1 = center.y < 255 - radius ? center.y + radius : 255;
+        uint8_t z1 = center.z < 255 - radius ? center.z + radius : 255;
+        uint16_t radiusSquared = radius * radius;
+        for (uint8_t cz = z0 >> LED_SPACE_CELL_BITS; cz <= z1 >> LED_SPACE_CELL_BITS; cz++) {
+            for (uint8_t cy = y0 >> LED_SPACE_CELL_BITS; cy <= y1 >> LED_SPACE_CELL_BITS; cy++) {
+                for (uint8_t cx = x0 >> LED_SPACE_CELL_BITS; cx <= x1 >> LED_SPACE_CELL_BITS; cx++) {
+                    uint16_t cell = cx | (cy << 3) | (cz << 6);
+                    for (uint16_t n = _cellStart[cell]; n < _cellStart[cell + 1]; n++) {
+                        const LedPoint &p = _cellPoints[n];
+                        int16_t dx = p.x - center.x;
+                        int16_t dy = p.y - center.y;
+                        int16_t dz = p.z - center.z;
+                        uint32_t distanceSquared = dx * dx + dy * dy + dz * dz;
+                        if (distanceSquared <= radiusSquared)
+                            visit(_cellLeds[n], (uint16_t)distanceSquared);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    const LedPoint *_points;
+    const uint16_t *_cellStart;
+    const uint16_t *_cellLeds;
+    const LedPoint *_cellPoints;
+    uint16_t _count;
+};
+
+#endif
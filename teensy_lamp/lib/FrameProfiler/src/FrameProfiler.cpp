@@ -0,0 +1,77 @@
+#include "FrameProfiler.h"
+
+static const char *stageNames[PROFILE_STAGE_COUNT] = {"serial", "effect", "output", "show", "frame"};
+
+void FrameProfiler::begin() {
+#ifndef NATIVE
+    // The Teensy 4 core normally has the cycle counter running already, make sure of it
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
+    reset();
+}
+
+void FrameProfiler::reset() {
+    memset(_stats, 0, sizeof(_stats));
+    for (uint8_t i = 0; i < PROFILE_STAGE_COUNT; i++)
+        _stats[i].min = UINT32_MAX;
+}
+
+// Values below 16 get a bucket each, above that every power of two is split into 8 buckets
+uint8_t FrameProfiler::bucketOf(uint32_t cycles) {
+    if (cycles < 16)
+        return cycles;
+    uint8_t exponent = 31 - __builtin_clz(cycles);
+    return 16 + (exponent - 4) * 8 + ((cycles >> (exponent - 3)) & 7);
+}
+
+uint32_t FrameProfiler::bucketUpperBound(uint8_t bucket) {
+    if (bucket < 16)
+        return bucket;
+    uint8_t exponent = (bucket - 16) / 8 + 4;
+    uint8_t step = (bucket - 16) % 8;
+    uint64_t next = (uint64_t)(8 + step + 1) << (exponent - 3);
+    return next > UINT32_MAX ? UINT32_MAX : next - 1;
+}
+
+void FrameProfiler::record(uint8_t stage, uint32_t cycles) {
+    Stats &stats = _stats[stage];
+    stats.count++;
+    stats.last = cycles;
+    stats.sum += cycles;
+    if (cycles < stats.min)
+        stats.min = cycles;
+    if (cycles > stats.max)
+        stats.max = cycles;
+    stats.buckets[bucketOf(cycles)]++;
+}
+
+uint32_t FrameProfiler::getCount(uint8_t stage) { return _stats[stage].count; }
+uint32_t FrameProfiler::getLast(uint8_t stage) { return _stats[stage].last; }
+uint32_t FrameProfiler::getMin(uint8_t stage) { return _stats[stage].count ? _stats[stage].min : 0; }
+uint32_t FrameProfiler::getMax(uint8_t stage) { return _stats[stage].max; }
+
+uint32_t FrameProfiler::getAverage(uint8_t stage) {
+    const Stats &stats = _stats[stage];
+    return stats.count ? stats.sum / stats.count : 0;
+}
+
+// permille = 990 for the 99th percentile
+uint32_t FrameProfiler::getPercentile(uint8_t stage, uint16_t permille) {
+    const Stats &stats = _stats[stage];
+    if (stats.count == 0)
+        return 0;
+    // Rank of the sample we are looking for, rounded up
+    uint64_t rank = ((uint64_t)stats.count * permille + 999) / 1000;
+    if (rank == 0)
+        rank = 1;
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < bucketCount; i++) {
+        seen += stats.buckets[i];
+        if (seen >= rank)
+            return min(bucketUpperBound(i), stats.max);
+    }
+    return stats.max;
+}
+
+const char *FrameProfiler::getStageName(uint8_t stage) { return stage < PROFILE_STAGE_COUNT ? stageNames[stage] : "?"; }
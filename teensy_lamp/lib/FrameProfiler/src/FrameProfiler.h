@@ -0,0 +1,65 @@
+/*"""
+
+ Frame Profiler:
+ Times the stages of a frame with the Cortex-M7 cycle counter (ARM_DWT_CYCCNT, emulated from the host
+ clock in the native build) and keeps min/avg/max and a histogram per stage, so percentiles can be
+ read without storing samples. Memory use is fixed.
+
+ The histogram has 8 buckets per power of two (exact below 16 cycles), so a percentile is accurate
+ to within 12.5%. Percentiles are reported as the upper edge of their bucket, clamped to the maximum.
+
+   profiler.start(PROFILE_EFFECT);
+   renderEffect();
+   profiler.stop(PROFILE_EFFECT);
+
+"""*/
+#ifndef FrameProfiler_H
+#define FrameProfiler_H
+#include "Arduino.h"
+#include <inttypes.h>
+
+enum ProfileStage {
+    PROFILE_SERIAL, // SerialHandler::update()
+    PROFILE_EFFECT, // the current effect rendering into the framebuffer
+    PROFILE_OUTPUT, // brightness and packing into the drawing memory
+    PROFILE_SHOW,   // handing the frame to the DMA, including the wait for the previous one
+    PROFILE_FRAME,  // the whole frame, from the effect to the hand-off
+    PROFILE_STAGE_COUNT,
+};
+
+class FrameProfiler {
+public:
+    static const uint8_t bucketCount = 240;
+
+    void begin();
+    static inline uint32_t now() { return ARM_DWT_CYCCNT; }
+    inline void start(uint8_t stage) { _started[stage] = now(); }
+    inline void stop(uint8_t stage) { record(stage, now() - _started[stage]); }
+    void record(uint8_t stage, uint32_t cycles);
+    void reset();
+
+    uint32_t getCount(uint8_t stage);
+    uint32_t getLast(uint8_t stage);
+    uint32_t getMin(uint8_t stage);
+    uint32_t getMax(uint8_t stage);
+    uint32_t getAverage(uint8_t stage);
+    uint32_t getPercentile(uint8_t stage, uint16_t permille);
+    static const char *getStageName(uint8_t stage);
+
+    static uint8_t bucketOf(uint32_t cycles);
+    static uint32_t bucketUpperBound(uint8_t bucket);
+
+private:
+    struct Stats {
+        uint32_t count;
+        uint32_t last;
+        uint32_t min;
+        uint32_t max;
+        uint64_t sum;
+        uint32_t buckets[bucketCount];
+    };
+    Stats _stats[PROFILE_STAGE_COUNT];
+    uint32_t _started[PROFILE_STAGE_COUNT];
+};
+
+#endif
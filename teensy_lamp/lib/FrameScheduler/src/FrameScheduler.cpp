@@ -0,0 +1,82 @@
+#include "FrameScheduler.h"
+
+void FrameScheduler::setTargetFps(uint16_t fps) {
+    if (fps == 0)
+        fps = 1;
+    _targetFps = fps;
+    _frameInterval = 1000000UL / fps;
+}
+
+uint16_t FrameScheduler::getTargetFps() { return _targetFps; }
+uint32_t FrameScheduler::getFrameInterval() { return _frameInterval; }
+
+// Same as setTargetFps(), in microseconds between frames
+void FrameScheduler::setFrameInterval(uint32_t interval) {
+    if (interval == 0)
+        interval = 1;
+    _frameInterval = interval;
+    _targetFps = 1000000UL / interval;
+}
+
+void FrameScheduler::setStatic(bool isStatic) { _static = isStatic; }
+
+bool FrameScheduler::frameDue() {
+    uint32_t now = micros();
+    _updateStats(now);
+
+    // Nothing can have changed
+    if (_static && !_dirty)
+        return false;
+
+    // Signed difference so the comparison survives the micros() wrap around
+    if ((int32_t)(now - _nextFrameTime) < 0)
+        return false;
+
+    _nextFrameTime += _frameInterval;
+    // Fell more than a frame behind (or first call), resynchronize instead of bursting to catch up
+    if ((int32_t)(now - _nextFrameTime) >= 0)
+        _nextFrameTime = now + _frameInterval;
+
+    _renderedInWindow++;
+    return true;
+}
+
+void FrameScheduler::markDirty() { _dirty = true; }
+
+bool FrameScheduler::present(uint32_t frameHash) {
+    if (!_dirty && frameHash == _lastHash) {
+        _skippedFrames++;
+        return false;
+    }
+    _dirty = false;
+    _lastHash = frameHash;
+    _shownInWindow++;
+    return true;
+}
+
+void FrameScheduler::_updateStats(uint32_t now) {
+    uint32_t elapsed = now - _statsTimer;
+    if (elapsed < 1000000UL)
+        return;
+    _fps = _renderedInWindow * 1000000.0f / elapsed;
+    _shownFps = _shownInWindow * 1000000.0f / elapsed;
+    _renderedInWindow = 0;
+    _shownInWindow = 0;
+    _statsTimer = now;
+}
+
+// Frames rendered per second, measured over the last second
+float FrameScheduler::getFps() { return _fps; }
+// Frames actually sent to the strip per second
+float FrameScheduler::getShownFps() { return _shownFps; }
+uint32_t FrameScheduler::getSkippedFrames() { return _skippedFrames; }
+
+// FNV-1a over the colors, one 0xRRGGBB word per LED. Pass the brightness as the seed so a brightness change also changes the hash.
+uint32_t FrameScheduler::hashFrame(const CRGB *frame, uint16_t ledCount, uint32_t seed) {
+    uint32_t hash = 2166136261UL ^ seed;
+    for (uint16_t i = 0; i < ledCount; i++) {
+        hash ^= ((uint32_t)frame[i].r << 16) | ((uint32_t)frame[i].g << 8) | frame[i].b;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
@@ -0,0 +1,51 @@
+/*"""
+
+ Frame Scheduler:
+ Paces rendering at a fixed target frame rate instead of as fast as loop() spins.
+ frameDue() returns true once per frame period; the caller renders the frame and then asks present()
+ whether it has to be sent to the strip. Frames whose hash matches the last shown frame are skipped,
+ unless the scheduler was marked dirty (e.g. on a mode change).
+ A static scheduler (for effects whose output only changes with their settings) does not report any frame
+ as due until it is marked dirty.
+
+"""*/
+#ifndef FrameScheduler_H
+#define FrameScheduler_H
+#include "Arduino.h"
+#include "FastLED.h"
+#include <inttypes.h>
+
+class FrameScheduler {
+public:
+    void setTargetFps(uint16_t fps);
+    uint16_t getTargetFps();
+    uint32_t getFrameInterval();
+    void setFrameInterval(uint32_t interval);
+    void setStatic(bool isStatic);
+    bool frameDue();
+    void markDirty();
+    bool present(uint32_t frameHash);
+    float getFps();
+    float getShownFps();
+    uint32_t getSkippedFrames();
+
+    static uint32_t hashFrame(const CRGB *frame, uint16_t ledCount, uint32_t seed = 0);
+
+private:
+    uint16_t _targetFps = 50;
+    uint32_t _frameInterval = 20000; // us
+    uint32_t _nextFrameTime = 0;
+    bool _dirty = true;
+    bool _static = false;
+    uint32_t _lastHash = 0;
+
+    uint32_t _statsTimer = 0;
+    uint32_t _renderedInWindow = 0;
+    uint32_t _shownInWindow = 0;
+    float _fps = 0;
+    float _shownFps = 0;
+    uint32_t _skippedFrames = 0;
+    void _updateStats(uint32_t now);
+};
+
+#endif
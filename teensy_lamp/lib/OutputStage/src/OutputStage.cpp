@@ -0,0 +1,161 @@
+#include "OutputStage.h"
+
+// Same values as the color order flags of OctoWS2811 (WS2811_RGB ... WS2811_BGR)
+static const uint8_t colorOrderOffsets[6][3] = {
+    // R, G, B
+    {0, 1, 2}, // RGB
+    {0, 2, 1}, // RBG
+    {1, 0, 2}, // GRB
+    {2, 0, 1}, // GBR
+    {1, 2, 0}, // BRG
+    {2, 1, 0}, // BGR
+};
+
+// Dithered levels, in 8.8: below, a LED switching between two steps flickers, above, a step is too small to see
+static const uint16_t ditherMin = 8 << 8;
+static const uint16_t ditherMax = 64 << 8;
+// Fraction bits that are dithered, one cycle is 2^ditherBits frames
+static const uint8_t ditherBits = 2;
+static const uint8_t ditherSteps = 1 << ditherBits;
+
+// Dither thresholds: the frame counter with its bits reversed, so any run of 2^n frames samples the
+// thresholds evenly
+struct DitherTable {
+    uint8_t thresholds[ditherSteps];
+    constexpr DitherTable() : thresholds() {
+        for (int i = 0; i < ditherSteps; i++) {
+            uint8_t reversed = 0;
+            for (int bit = 0; bit < ditherBits; bit++)
+                reversed |= ((i >> bit) & 1) << (ditherBits - 1 - bit);
+            thresholds[i] = reversed << (8 - ditherBits);
+        }
+    }
+};
+
+static constexpr DitherTable dither{};
+
+void OutputStage::begin(OctoWS2811 &leds, void *drawingMemory, uint16_t ledCount, int config) {
+    _leds = &leds;
+    _drawingMemory = (uint8_t *)drawingMemory;
+    _ledCount = ledCount;
+    uint8_t order = config & 0x07;
+    if (order > 5)
+        order = 0;
+    _offsetR = colorOrderOffsets[order][0];
+    _offsetG = colorOrderOffsets[order][1];
+    _offsetB = colorOrderOffsets[order][2];
+    _updateLut();
+}
+
+// Logical to drawing memory index of every LED, e.g. LedMap::physical. nullptr for a single pin in order.
+void OutputStage::setLayout(const uint16_t *physical) { _physical = physical; }
+
+void OutputStage::setBrightness(uint8_t brightness) {
+    if (brightness == _brightness)
+        return;
+    _brightness = brightness;
+    _updateLut();
+}
+
+void OutputStage::setGamma(float gamma) {
+    if (gamma == _gamma || gamma <= 0)
+        return;
+    _gamma = gamma;
+    _updateLut();
+}
+
+// Off: the next frames are rounded to the nearest step and isDithering() stays false
+void OutputStage::setDithering(bool enabled) { _ditherEnabled = enabled; }
+
+uint8_t OutputStage::getBrightness() { return _brightness; }
+float OutputStage::getGamma() { return _gamma; }
+
+// Some channel of the last frame has a fraction, frames have to keep coming for the dithering to work
+bool OutputStage::isDithering() { return _dithering; }
+
+// 8.8 fixed-point output level of one channel value
+uint16_t OutputStage::getLevel(uint8_t value) { return _lut[value]; }
+
+// How often the lookup table was rebuilt
+uint32_t OutputStage::getLutUpdates() { return _lutUpdates; }
+
+void OutputStage::_updateLut() {
+    // Full brightness is an exact identity whatever the gamma
+    float scale = _brightness == 255 ? 1.0f : powf(_brightness / 255.0f, _gamma);
+    _lutFractions = false;
+    for (int value = 0; value < 256; value++) {
+        uint16_t level = value * scale * 256.0f + 0.5f;
+        // Quarter steps where dithering helps, whole ones everywhere else
+        uint16_t step = level >= ditherMin && level < ditherMax ? 0x100 >> ditherBits : 0x100;
+        level = (level + step / 2) & ~(step - 1);
+        _lut[value] = level;
+        if (level & 0xFF)
+            _lutFractions = true;
+    }
+    _lutUpdates++;
+}
+
+void OutputStage::write(const CRGB *frame) {
+    uint32_t start = ARM_DWT_CYCCNT;
+    const uint16_t *lut = _lut;
+    const uint16_t *physical = _physical;
+    uint8_t *drawing = _drawingMemory;
+    // Copies in registers: stores through the byte pointer could alias the members and the frame
+    uint8_t offsetR = _offsetR, offsetG = _offsetG, offsetB = _offsetB;
+
+    _dithering = false;
+    if (_lutFractions && _ditherEnabled) {
+        // Neighbouring LEDs start at different points of the threshold sequence, so they do not all step at once
+        uint8_t frameIndex = _ditherFrame++;
+        uint16_t fractions = 0;
+        for (uint16_t i = 0; i < _ledCount; i++) {
+            CRGB color = frame[i];
+            uint8_t threshold = dither.thresholds[(frameIndex + i) & (ditherSteps - 1)];
+            uint16_t r = lut[color.r];
+            uint16_t g = lut[color.g];
+            uint16_t b = lut[color.b];
+            fractions |= r | g | b;
+            uint8_t *dest = drawing + (physical ? physical[i] : i) * 3;
+            dest[offsetR] = (r >> 8) + ((r & 0xFF) > threshold);
+            dest[offsetG] = (g >> 8) + ((g & 0xFF) > threshold);
+            dest[offsetB] = (b >> 8) + ((b & 0xFF) > threshold);
+        }
+        _dithering = (fractions & 0xFF) != 0;
+    } else {
+        for (uint16_t i = 0; i < _ledCount; i++) {
+            CRGB color = frame[i];
+            uint8_t *dest = drawing + (physical ? physical[i] : i) * 3;
+            dest[offsetR] = (lut[color.r] + 0x80) >> 8;
+            dest[offsetG] = (lut[color.g] + 0x80) >> 8;
+            dest[offsetB] = (lut[color.b] + 0x80) >> 8;
+        }
+    }
+    _cycles = ARM_DWT_CYCCNT - start;
+    _pending = true;
+}
+
+// Hand the packed frame over to the DMA. Only waits if the previous transfer is still in flight.
+void OutputStage::show() {
+    uint32_t start = ARM_DWT_CYCCNT;
+    while (_leds->busy())
+        ;
+    _waitCycles = ARM_DWT_CYCCNT - start;
+    if (_waitCycles > _maxWaitCycles)
+        _maxWaitCycles = _waitCycles;
+    _leds->show();
+    _pending = false;
+}
+
+// The previous frame is still being clocked out
+bool OutputStage::isBusy() { return _leds->busy(); }
+
+// A frame was written but not handed over yet
+bool OutputStage::isPending() { return _pending; }
+
+// Cycles spent in the last write()
+uint32_t OutputStage::getCycles() { return _cycles; }
+
+// Cycles the last show() spent waiting for the previous transfer
+uint32_t OutputStage::getWaitCycles() { return _waitCycles; }
+uint32_t OutputStage::getMaxWaitCycles() { return _maxWaitCycles; }
+void OutputStage::resetWaitStats() { _maxWaitCycles = 0; }
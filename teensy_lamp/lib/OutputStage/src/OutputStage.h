@@ -0,0 +1,82 @@
+/*"""
+
+ Output Stage:
+ Effects draw into an unscaled logical CRGB framebuffer.
+ The output stage applies the global brightness and packs the result straight into the OctoWS2811 drawing
+ memory in wire order, in a single pass: the only conversion between FastLED's CRGB and OctoWS2811.
+ The framebuffer is never scaled in place, so effects can keep their own state in it.
+ With a layout (see LedLayout.h) every logical LED is packed to its pixel on its pin, so effects keep
+ addressing one contiguous strip however it is split over the OctoWS2811 pins.
+
+ Brightness goes through a gamma curve (2.2 by default, 1 is linear) so equal brightness steps look equal.
+ Every channel value maps through a 256 entry lookup table to an 8.8 fixed-point level, the table is rebuilt
+ only when the brightness or the gamma changes. Levels from 8 to 64 keep a fraction in quarter steps, which is
+ rendered by temporal dithering: each frame rounds up against a different threshold, so over 4 consecutive
+ frames a LED averages the exact level. Below 8 a LED switching between two steps flickers visibly, above 64
+ one step is too small to see, so those levels are rounded. As long as isDithering() is true, i.e. the last
+ frame had a dithered channel, the same frame should be written and shown again as often as the strip
+ allows. A frame that stays on the strip is better written once with setDithering(false), which rounds
+ every level to the nearest step, than re-sent for good.
+
+ OctoWS2811 clocks frames out of its own display memory, so the next frame can be computed and packed while
+ the previous one is still on the wire. show() is the only hand-off point: it blocks until the transfer in
+ flight is done and records how long it had to wait. Callers that do not want to block poll isBusy() first.
+
+"""*/
+#ifndef OutputStage_H
+#define OutputStage_H
+#include "Arduino.h"
+#include "FastLED.h"
+#include "LedLayout.h"
+#include <OctoWS2811.h>
+#include <inttypes.h>
+
+class OutputStage {
+public:
+    void begin(OctoWS2811 &leds, void *drawingMemory, uint16_t ledCount, int config);
+    void setLayout(const uint16_t *physical);
+    void setBrightness(uint8_t brightness);
+    void setGamma(float gamma);
+    void setDithering(bool enabled);
+    void write(const CRGB *frame);
+    void show();
+    bool isBusy();
+    bool isPending();
+    uint8_t getBrightness();
+    float getGamma();
+    bool isDithering();
+    uint16_t getLevel(uint8_t value);
+    uint32_t getLutUpdates();
+    uint32_t getCycles();
+    uint32_t getWaitCycles();
+    uint32_t getMaxWaitCycles();
+    void resetWaitStats();
+
+private:
+    OctoWS2811 *_leds = nullptr;
+    uint8_t *_drawingMemory = nullptr;
+    uint16_t _ledCount = 0;
+    // Drawing memory pixel of every logical LED, nullptr when they are the same
+    const uint16_t *_physical = nullptr;
+    uint8_t _brightness = 255;
+    float _gamma = 2.2f;
+    // Output level of every channel value at the current brightness, 8.8 fixed point, at most 255.0
+    uint16_t _lut[256];
+    // Some level of the table has a fraction, and some channel of the last frame had one
+    bool _lutFractions = false;
+    bool _dithering = false;
+    bool _ditherEnabled = true;
+    uint8_t _ditherFrame = 0;
+    uint32_t _lutUpdates = 0;
+    void _updateLut();
+    uint32_t _cycles = 0;
+    uint32_t _waitCycles = 0;
+    uint32_t _maxWaitCycles = 0;
+    bool _pending = false;
+    // Byte offsets of red, green and blue inside one pixel of the drawing memory
+    uint8_t _offsetR = 1;
+    uint8_t _offsetG = 0;
+    uint8_t _offsetB = 2;
+};
+
+#endif
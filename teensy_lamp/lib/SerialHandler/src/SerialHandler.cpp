@@ -9,11 +9,15 @@
  Different values inside the payload are separated by a '_separator'.
  SERIAL_SEPERATOR_CH = '#'
 _separator = '#'
+
+ Binary frames (see LampProtocol.h) are accepted between ASCII messages. A frame that has started
+ receives every byte until it is complete, so payload bytes are never mistaken for markers.
 """*/
 
 void SerialHandler::update() {
     _printPeriodically(_printFrequency, _debug);
     _receiveNonBlocking();
+    _updateStats();
 }
 
 void SerialHandler::setSerial(Stream &serial) {
@@ -27,80 +31,187 @@ void SerialHandler::setStartMarker(char startMarker) { _startMarker = startMarke
 
 void SerialHandler::setSeperator(char seperator) { _separator = seperator; }
 
+// Drain everything the UART has into the ring buffer, then parse up to _receiveBudget bytes of it.
+// Bytes over the budget wait in the ring buffer for the next update instead of piling up in the UART.
 void SerialHandler::_receiveNonBlocking() {
-    static boolean recvInProgress = false;
-    static byte ndx = 0;
-    char rc;
+    int available = _serial->available();
+    while (available-- > 0) {
+        uint16_t next = (_ringHead + 1) & _ringMask;
+        if (next == _ringTail) {
+            _overflows++;
+            break;
+        }
+        _ring[_ringHead] = _serial->read();
+        _ringHead = next;
+    }
+
+    uint16_t budget = _receiveBudget;
+    while (_ringTail != _ringHead && budget > 0) {
+        char rc = _ring[_ringTail];
+        _ringTail = (_ringTail + 1) & _ringMask;
+        budget--;
+        _bytesInWindow++;
+        _receiveByte(rc);
+    }
+}
 
-    if (_serial->available() <= 0)
+void SerialHandler::_receiveByte(char rc) {
+    if (!_recvInProgress && (_protocol.isReceiving() || (uint8_t)rc == LampProtocol::SYNC)) {
+        if (_protocol.feed(rc)) {
+            _messagesInWindow++;
+            _handlePacket(_protocol.getType(), _protocol.getPayload(), _protocol.getLength());
+        }
         return;
-    rc = _serial->read();
-    if (recvInProgress == true) {
+    }
+    if (_recvInProgress == true) {
         if (rc != _endMarker) {
-            _receivedChars[ndx] = rc;
-            ndx++;
-            if (ndx >= _numChars) {
+            _receivedChars[_ndx] = rc;
+            _ndx++;
+            if (_ndx >= _numChars) {
                 this->pln("Buffer Overflow");
-                ndx = _numChars - 1;
+                _overflows++;
+                _ndx = _numChars - 1;
             }
         } else {
             // digitalWrite(13, !digitalRead(13));
-            _receivedChars[ndx] = '\0'; // terminate the string when the end marker arrives
-            recvInProgress = false;
-            ndx = 0;
-            this->parseString(_receivedChars);
+            _receivedChars[_ndx] = '\0'; // terminate the string when the end marker arrives
+            _recvInProgress = false;
+            _messagesInWindow++;
+            this->parseString(_receivedChars, _ndx);
+            _ndx = 0;
         }
     } else if (rc == _startMarker) {
-        recvInProgress = true;
+        _recvInProgress = true;
     } else {
         // Serial.print(rc);
     }
 }
 
-void SerialHandler::parseString(char *string) {
-    const char seperator[2] = {_separator, '\0'};
-    char messageType = string[0];
-    // Remove the first character from the string using memmove. First character is the message type.
-    memmove(string, string + 1, strlen(string));
-
-    switch (messageType) {
-    case 'R': {
-        // Parse the message in the following format: <R255>
-        // Start, end and messagetype characters are already removed. So it is 255 which is a number.
-        // Set the red value to that number.
-        int val = atoi(string);
-        r = val;
-        break;
+void SerialHandler::_updateStats() {
+    uint32_t elapsed = millis() - _statsTimer;
+    if (elapsed < 1000)
+        return;
+    _bytesPerSecond = _bytesInWindow * 1000.0f / elapsed;
+    _messagesPerSecond = _messagesInWindow * 1000.0f / elapsed;
+    _bytesInWindow = 0;
+    _messagesInWindow = 0;
+    _statsTimer = millis();
+}
+
+void SerialHandler::setReceiveBudget(uint16_t bytesPerUpdate) { _receiveBudget = bytesPerUpdate; }
+
+float SerialHandler::getBytesPerSecond() { return _bytesPerSecond; }
+float SerialHandler::getMessagesPerSecond() { return _messagesPerSecond; }
+// Ring buffer full while the UART still had data, or a message longer than the message buffer
+uint32_t SerialHandler::getOverflows() { return _overflows; }
+
+// Handlers for the ASCII messages, see messageTable below
+struct SerialMessages {
+    // <R255>, <G255>, <B255>: one color channel. Brightness follows the strongest channel.
+    // ASCII changes always switch at once
+    static void setRed(SerialHandler &handler, uint32_t value) {
+        handler.fade = 0;
+        handler.r = value;
+        handler.brightness = max(handler.r, max(handler.g, handler.b));
     }
-    case 'G': {
-        // Parse the message in the following format: <G255>
-        // Start, end and messagetype characters are already removed. So it is 255 which is a number.
-        // Set the green value to that number.
-        int val = atoi(string);
-        g = val;
-        break;
+    static void setGreen(SerialHandler &handler, uint32_t value) {
+        handler.fade = 0;
+        handler.g = value;
+        handler.brightness = max(handler.r, max(handler.g, handler.b));
     }
-    case 'B': {
-        // Parse the message in the following format: <B255>
-        // Start, end and messagetype characters are already removed. So it is 255 which is a number.
-        // Set the blue value to that number.
-        int val = atoi(string);
-        b = val;
-        break;
+    static void setBlue(SerialHandler &handler, uint32_t value) {
+        handler.fade = 0;
+        handler.b = value;
+        handler.brightness = max(handler.r, max(handler.g, handler.b));
+    }
+    // <M0>: LED mode
+    static void setMode(SerialHandler &handler, uint32_t value) {
+        handler.fade = 0;
+        handler.mode = value;
     }
-    case 'M': {
+    // <P0>: report the frame profiler stats, <P1>: report and start a new window
+    static void queryStats(SerialHandler &handler, uint32_t value) {
+        if (handler._statsQuery)
+            handler._statsQuery(handler, value);
+    }
+};
+
+static constexpr MessageDescriptor<SerialHandler> messageTable[] = {
+    // type, base, min digits, max digits, min value, max value, handler
+    {'R', 10, 1, 3, 0, 255, &SerialMessages::setRed},
+    {'G', 10, 1, 3, 0, 255, &SerialMessages::setGreen},
+    {'B', 10, 1, 3, 0, 255, &SerialMessages::setBlue},
+    {'M', 10, 1, 3, 0, 255, &SerialMessages::setMode},
+    {'P', 10, 1, 1, 0, 1, &SerialMessages::queryStats},
+};
+
+// Parse the body of one ASCII message in place, e.g. "R255" for <R255>
+void SerialHandler::parseString(const char *message, uint8_t length) {
+    if (parseMessage(messageTable, *this, message, length) != MESSAGE_OK)
+        _rejectedMessages++;
+}
 
-        // Parse the message in the following format: <M0>
-        // Start, end and messagetype characters are already removed. So it is 0 which is a number.
-        // Set the mode to that number.
-        int val = atoi(string);
-        mode = val;
+// Called for <P0>/<P1>, the answer is up to the application. It should reply on this handler's serial.
+void SerialHandler::setStatsQuery(void (*query)(SerialHandler &handler, uint32_t value)) { _statsQuery = query; }
+
+// Malformed, unknown or out of range ASCII messages
+uint32_t SerialHandler::getRejectedMessages() { return _rejectedMessages; }
+
+void SerialHandler::_handlePacket(uint8_t type, const uint8_t *payload, uint8_t length) {
+    _lastPacketTime = millis();
+    switch (type) {
+    case LAMP_MSG_STATE: {
+        // Apply the whole state at once so no frame is rendered with a half updated color
+        LampState state;
+        uint16_t sequence;
+        if (!LampProtocol::decodeState(payload, length, state, sequence))
+            break;
+        // Same sequence again means our ACK got lost and the ESP32 retransmitted
+        if (sequence == _appliedSequence)
+            _duplicateStates++;
+        r = state.r;
+        g = state.g;
+        b = state.b;
+        mode = state.mode;
+        brightness = state.brightness;
+        fade = state.fade;
+        _appliedSequence = sequence;
+        _sendAck();
+        break;
+    }
+    case LAMP_MSG_HEARTBEAT: {
+        // Tell the ESP32 what we have, it pushes the state again if that is not its latest one
+        uint16_t sequence;
+        if (LampProtocol::decodeSequence(payload, length, sequence))
+            _sendAck();
         break;
     }
     }
-    return;
 }
 
+void SerialHandler::_sendAck() {
+    uint8_t frame[LampProtocol::MAX_FRAME];
+    uint8_t frameLength = LampProtocol::encodeSequence(LAMP_MSG_ACK, _appliedSequence, frame);
+    _serial->write(frame, frameLength);
+    _acksSent++;
+}
+
+uint16_t SerialHandler::getAppliedSequence() { return _appliedSequence; }
+uint32_t SerialHandler::getAcksSent() { return _acksSent; }
+// States received again with an already applied sequence, i.e. retransmits seen by this end
+uint32_t SerialHandler::getDuplicateStates() { return _duplicateStates; }
+// Time since the last valid binary frame, grows when the link is down
+uint32_t SerialHandler::getLinkAge() { return millis() - _lastPacketTime; }
+
+// Send a binary frame in a single write
+void SerialHandler::sendPacket(uint8_t type, const uint8_t *payload, uint8_t length) {
+    uint8_t frame[LampProtocol::MAX_FRAME];
+    uint8_t frameLength = LampProtocol::encode(type, payload, length, frame);
+    _serial->write(frame, frameLength);
+}
+
+LampProtocol &SerialHandler::getProtocol() { return _protocol; }
+
 void SerialHandler::_printPeriodically(float freq, bool debug = false) {
     if (freq <= 0)
         return;
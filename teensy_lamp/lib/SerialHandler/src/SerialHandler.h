@@ -15,6 +15,8 @@
 #ifndef SerialHandler_H
 #define SerialHandler_H
 #include "Arduino.h"
+#include "LampProtocol.h"
+#include "MessageParser.h"
 #include "advancedSerial.h"
 #include <inttypes.h>
 
@@ -24,6 +26,8 @@ enum SerialConnectionApp {
 };
 
 class SerialHandler : public advancedSerial {
+    friend struct SerialMessages;
+
 public:
     void update();
     void setSerial(Stream &serial);
@@ -32,15 +36,29 @@ public:
     void setSeperator(char seperator);
     void setDebug(bool debug);
     void setPrintFrequency(float printFrequency);
-    void parseString(char *string);
+    void setReceiveBudget(uint16_t bytesPerUpdate);
+    void setStatsQuery(void (*query)(SerialHandler &handler, uint32_t value));
+    void parseString(const char *message, uint8_t length);
+    uint32_t getRejectedMessages();
+    void sendPacket(uint8_t type, const uint8_t *payload, uint8_t length);
+    LampProtocol &getProtocol();
+    uint16_t getAppliedSequence();
+    uint32_t getAcksSent();
+    uint32_t getDuplicateStates();
+    uint32_t getLinkAge();
     char getStartMarker();
     char getEndMarker();
     Stream &getSerial();
+    float getBytesPerSecond();
+    float getMessagesPerSecond();
+    uint32_t getOverflows();
 
     uint8_t r = 0;
     uint8_t g = 0;
     uint8_t b = 0;
     uint8_t mode = 0;
+    uint8_t brightness = 0;
+    uint32_t fade = 0; // ms to fade into the last received state, 0 = at once
 
 private:
     float _printFrequency = 1;
@@ -56,6 +74,34 @@ private:
     char _receivedChars[_numChars];
     void _printPeriodically(float frequency, bool debug);
     void _receiveNonBlocking(void);
+    void _receiveByte(char rc);
+    void _updateStats(void);
+
+    // Received bytes wait here until they are parsed. Size must be a power of two.
+    static const uint16_t _ringSize = 256;
+    static const uint16_t _ringMask = _ringSize - 1;
+    uint8_t _ring[_ringSize];
+    uint16_t _ringHead = 0;
+    uint16_t _ringTail = 0;
+    uint16_t _receiveBudget = 128;
+    bool _recvInProgress = false;
+    byte _ndx = 0;
+
+    uint32_t _statsTimer = 0;
+    uint32_t _bytesInWindow = 0;
+    uint32_t _messagesInWindow = 0;
+    float _bytesPerSecond = 0;
+    float _messagesPerSecond = 0;
+    uint32_t _overflows = 0;
+    uint32_t _rejectedMessages = 0;
+    void (*_statsQuery)(SerialHandler &handler, uint32_t value) = nullptr;
+    void _handlePacket(uint8_t type, const uint8_t *payload, uint8_t length);
+    void _sendAck();
+    LampProtocol _protocol;
+    uint16_t _appliedSequence = 0;
+    uint32_t _acksSent = 0;
+    uint32_t _duplicateStates = 0;
+    uint32_t _lastPacketTime = 0;
 };
 
 #include "Arduino.h"
@@ -9,6 +9,93 @@
 #include <stdarg.h>
 #include "Arduino.h"
 
+/*! * Highest advancedLogger level that is compiled in, 0 = v ... 3 = vvvv.
+    * Entries above it compile to nothing. Set it with -D ADVANCED_SERIAL_LOG_LEVEL=<n> in build_flags.
+    */
+#ifndef ADVANCED_SERIAL_LOG_LEVEL
+#define ADVANCED_SERIAL_LOG_LEVEL 0
+#endif
+
+/*! * Formats a whole message into a stack buffer. Derived classes decide where send() puts it.
+    * A message that does not fit is dropped as a whole instead of being sent truncated.
+    */
+template <typename Derived>
+class advancedSerialFormat {
+public:
+    static const uint8_t capacity = 128;
+
+    advancedSerialFormat() : _length(0), _overflow(false) {}
+
+    Derived& p(char c) {
+      if ( _length >= capacity ) { _overflow = true; return self(); }
+      _buffer[_length++] = c;
+      return self();
+    }
+
+    Derived& p(const char *s) {
+      while ( *s ) p(*s++);
+      return self();
+    }
+
+    Derived& p(unsigned long n, int base = DEC) {
+      char digits[32];
+      uint8_t count = 0;
+      do {
+        uint8_t d = n % base;
+        digits[count++] = d < 10 ? '0' + d : 'A' + d - 10;
+        n /= base;
+      } while ( n > 0 );
+      while ( count > 0 ) p(digits[--count]);
+      return self();
+    }
+
+    Derived& p(long n, int base = DEC) {
+      if ( n < 0 && base == DEC ) {
+        p('-');
+        return p(0UL - (unsigned long)n, base);
+      }
+      return p((unsigned long)n, base);
+    }
+
+    inline Derived& p(int n, int base = DEC)           { return p((long)n, base); }
+    inline Derived& p(unsigned int n, int base = DEC)  { return p((unsigned long)n, base); }
+    // Same as Print: an unsigned char is printed as a number, a char as a character
+    inline Derived& p(unsigned char n, int base = DEC) { return p((unsigned long)n, base); }
+
+    Derived& p(double n, int digits) {
+      if ( n < 0 ) { p('-'); n = -n; }
+      double rounding = 0.5;
+      for ( int i = 0; i < digits; i++ ) rounding /= 10.0;
+      n += rounding;
+      unsigned long integer = (unsigned long)n;
+      p(integer);
+      if ( digits > 0 ) p('.');
+      double fraction = n - integer;
+      for ( int i = 0; i < digits; i++ ) {
+        fraction *= 10.0;
+        uint8_t d = (uint8_t)fraction;
+        p((char)('0' + d));
+        fraction -= d;
+      }
+      return self();
+    }
+
+    Derived& bytes(const uint8_t *data, uint8_t count) {
+      for ( uint8_t i = 0; i < count; i++ ) p((char)data[i]);
+      return self();
+    }
+
+    inline Derived& ln(void) { return p('\n'); }
+
+protected:
+    char _buffer[capacity];
+    uint8_t _length;
+    bool _overflow;
+
+private:
+    inline Derived& self(void) { return static_cast<Derived&>(*this); }
+};
+
 class advancedSerial {
 public:
     enum class Level { v, vv, vvv, vvvv };
@@ -25,6 +112,28 @@ private:
 
     inline bool shouldBePrinted(void) { return _output_enabled && ( _message_level <= _filter_level ); }
 public:
+    /*! * Formats a whole message into a stack buffer and sends it with a single write().
+        * No line terminator is added unless ln() is called.
+        *
+        *   SH.msg().p('<').p('R').p(red).p('>').send();
+        */
+    class Message : public advancedSerialFormat<Message> {
+    public:
+      explicit Message(advancedSerial &owner) : _owner(owner) {}
+
+      // Returns false if the message was filtered out or did not fit
+      bool send(void) {
+        if ( _overflow || !_owner.shouldBePrinted() ) return false;
+        _owner._printer->write((const uint8_t *)_buffer, _length);
+        return true;
+      }
+
+    private:
+      advancedSerial &_owner;
+    };
+
+    inline Message msg(void) { return Message(*this); }
+
     /*! * default Constructor */
     advancedSerial()
       : _output_enabled(true),
@@ -126,6 +235,137 @@ public:
     inline advancedSerial& pln(void) { return println(); }
 };
 
+class advancedLogger;
+
+/*! * One entry of the advancedLogger, formatted on the stack and copied into the ring buffer by send().
+    */
+template <bool Enabled>
+class advancedLogEntry : public advancedSerialFormat<advancedLogEntry<Enabled> > {
+public:
+    explicit advancedLogEntry(advancedLogger &owner) : _owner(owner) {}
+
+    // Returns false if the entry did not fit and was dropped
+    bool send(void);
+
+private:
+    advancedLogger &_owner;
+};
+
+// Filtered out at compile time, everything is a no-op
+template <>
+class advancedLogEntry<false> {
+public:
+    explicit advancedLogEntry(advancedLogger &) {}
+    template <typename Type>
+    inline advancedLogEntry& p(Type) { return *this; }
+    template <typename Type>
+    inline advancedLogEntry& p(Type, int) { return *this; }
+    inline advancedLogEntry& bytes(const uint8_t *, uint8_t) { return *this; }
+    inline advancedLogEntry& ln(void) { return *this; }
+    inline bool send(void) { return false; }
+};
+
+/*! * Deferred logger. Entries are formatted on the stack and copied into a fixed size ring buffer,
+    * drain() writes them out later, only as much as the printer can take without blocking.
+    * Call it when the loop has nothing else to do. Entries that do not fit into the ring buffer
+    * are dropped and counted.
+    *
+    * Levels are filtered at compile time: logger.vv() above ADVANCED_SERIAL_LOG_LEVEL returns an
+    * entry whose methods are empty, so the formatting compiles away. Its arguments are still
+    * evaluated. ADVANCED_LOG() puts the whole call behind a constant condition instead, so a
+    * filtered entry evaluates nothing at all, use it on hot paths and for arguments that cost.
+    *
+    *   logger.vv().p("Mode: ").p(mode).ln().send();
+    *   ADVANCED_LOG(logger, vv).p("Frame: ").p(profiler.getLast(PROFILE_FRAME)).ln().send();
+    *
+    * One producer (the main loop) and one consumer (drain()), so head and tail need no lock.
+    */
+class advancedLogger {
+public:
+    static const uint16_t size = 2048; // must be a power of two
+    static const uint16_t mask = size - 1;
+
+    advancedLogger() : _printer(nullptr), _head(0), _tail(0), _dropped(0) {}
+
+    void setPrinter(Print &printer) {
+      _printer = &printer;
+    }
+
+    // Entries of this level are compiled in
+    static constexpr bool enabled(advancedSerial::Level level) { return (int)level <= ADVANCED_SERIAL_LOG_LEVEL; }
+
+    template <advancedSerial::Level L>
+    inline advancedLogEntry<((int)L <= ADVANCED_SERIAL_LOG_LEVEL)> at(void) {
+      return advancedLogEntry<((int)L <= ADVANCED_SERIAL_LOG_LEVEL)>(*this);
+    }
+    inline advancedLogEntry<(0 <= ADVANCED_SERIAL_LOG_LEVEL)> v(void)    { return at<advancedSerial::Level::v>(); }
+    inline advancedLogEntry<(1 <= ADVANCED_SERIAL_LOG_LEVEL)> vv(void)   { return at<advancedSerial::Level::vv>(); }
+    inline advancedLogEntry<(2 <= ADVANCED_SERIAL_LOG_LEVEL)> vvv(void)  { return at<advancedSerial::Level::vvv>(); }
+    inline advancedLogEntry<(3 <= ADVANCED_SERIAL_LOG_LEVEL)> vvvv(void) { return at<advancedSerial::Level::vvvv>(); }
+
+    // Copy a whole entry into the ring buffer, or drop it if there is not enough room
+    bool push(const char *data, uint16_t length) {
+      uint16_t head = _head;
+      uint16_t used = (head - _tail) & mask;
+      if ( length > mask - used ) {
+        _dropped++;
+        return false;
+      }
+      for ( uint16_t i = 0; i < length; i++ ) {
+        _ring[(head + i) & mask] = data[i];
+      }
+      _head = (head + length) & mask;
+      return true;
+    }
+
+    // Count an entry that was dropped before it reached the ring buffer
+    void drop(void) { _dropped++; }
+
+    // Write buffered entries without blocking, at most maxBytes per call
+    void drain(uint16_t maxBytes = 256) {
+      if ( _printer == nullptr ) return;
+      uint16_t tail = _tail;
+      uint16_t used = (_head - tail) & mask;
+      int room = _printer->availableForWrite();
+      if ( room <= 0 || used == 0 ) return;
+      uint16_t count = min((uint16_t)min((int)used, room), maxBytes);
+      // At most two contiguous chunks because of the wrap around
+      uint16_t first = min(count, (uint16_t)(size - tail));
+      _printer->write((const uint8_t *)&_ring[tail], first);
+      if ( count > first ) _printer->write((const uint8_t *)_ring, count - first);
+      _tail = (tail + count) & mask;
+    }
+
+    uint16_t pending(void) { return (_head - _tail) & mask; }
+    uint32_t getDropped(void) { return _dropped; }
+
+private:
+    Print* _printer;
+    char _ring[size];
+    volatile uint16_t _head;
+    volatile uint16_t _tail;
+    volatile uint32_t _dropped;
+};
+
+/*! * A log entry of the given level whose arguments are not evaluated when the level is filtered out,
+    * the rest of the call is the same as with logger.<level>():
+    *
+    *   ADVANCED_LOG(logger, vv).p("touch ").p(event.micros).ln().send();
+    */
+#define ADVANCED_LOG(logger, level) \
+    if (!advancedLogger::enabled(advancedSerial::Level::level)) { \
+    } else \
+      (logger).level()
+
+template <bool Enabled>
+bool advancedLogEntry<Enabled>::send(void) {
+    if ( this->_overflow ) {
+      _owner.drop();
+      return false;
+    }
+    return _owner.push(this->_buffer, this->_length);
+}
+
 //extern advancedSerial aSerial;
 typedef advancedSerial::Level Level;
 #endif
@@ -0,0 +1,132 @@
+#include "Arduino.h"
+#include <chrono>
+
+static bool realtime = false;
+static uint64_t virtualMicros = 0;
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+static uint64_t hostNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void nativeUseRealtime(bool enable) { realtime = enable; }
+void nativeSetMicros(uint64_t us) { virtualMicros = us; }
+void nativeAdvanceMicros(uint64_t us) { virtualMicros += us; }
+uint64_t nativeMicros() { return realtime ? hostNanos() / 1000 : virtualMicros; }
+
+unsigned long millis() { return nativeMicros() / 1000; }
+unsigned long micros() { return nativeMicros(); }
+
+void delay(unsigned long ms) { delayMicroseconds(ms * 1000); }
+
+void delayMicroseconds(unsigned int us) {
+    if (!realtime) {
+        virtualMicros += us;
+        return;
+    }
+    uint64_t end = hostNanos() + us * 1000ULL;
+    while (hostNanos() < end)
+        ;
+}
+
+// Cycles of a Teensy running at F_CPU_ACTUAL for the host time passed, only meaningful for differences
+uint32_t nativeCycleCount() { return (uint32_t)(hostNanos() * (F_CPU_ACTUAL / 1000000) / 1000); }
+
+// xorshift32, seeded like the Arduino core so randomSeed() gives reproducible runs
+static uint32_t randomState = 1;
+
+static uint32_t nextRandom() {
+    uint32_t x = randomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    randomState = x;
+    return x;
+}
+
+void randomSeed(unsigned long seed) { randomState = seed ? seed : 1; }
+
+long random(long howbig) {
+    if (howbig <= 0)
+        return 0;
+    return nextRandom() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+    if (howsmall >= howbig)
+        return howsmall;
+    return howsmall + random(howbig - howsmall);
+}
+
+size_t Print::print(unsigned long n, int base) {
+    char buffer[34];
+    char *p = buffer + sizeof(buffer) - 1;
+    *p = '\0';
+    do {
+        uint8_t d = n % base;
+        *--p = d < 10 ? '0' + d : 'A' + d - 10;
+        n /= base;
+    } while (n > 0);
+    return write(p);
+}
+
+size_t Print::print(long n, int base) {
+    if (n < 0 && base == DEC)
+        return print('-') + print(0UL - (unsigned long)n, base);
+    return print((unsigned long)n, base);
+}
+
+size_t Print::print(double n, int digits) {
+    char buffer[48];
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+    return write(buffer);
+}
+
+int Print::printf(const char *format, ...) {
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    write(buffer);
+    return length;
+}
+
+size_t NativeSerial::write(uint8_t c) { return write(&c, 1); }
+
+size_t NativeSerial::write(const uint8_t *buffer, size_t size) {
+    if (_echo)
+        fwrite(buffer, 1, size, stdout);
+    if (_capture) {
+        size_t room = _bufferSize - _txLength;
+        size_t count = size < room ? size : room;
+        memcpy(_tx + _txLength, buffer, count);
+        _txLength += count;
+    }
+    _bytesWritten += size;
+    return size;
+}
+
+void NativeSerial::inject(const uint8_t *data, size_t length) {
+    // Compact the already consumed part before appending
+    memmove(_rx, _rx + _rxIndex, _rxLength - _rxIndex);
+    _rxLength -= _rxIndex;
+    _rxIndex = 0;
+    if (length > _bufferSize - _rxLength)
+        length = _bufferSize - _rxLength;
+    memcpy(_rx + _rxLength, data, length);
+    _rxLength += length;
+}
+
+// Take everything written since the last call (when capturing)
+size_t NativeSerial::captured(uint8_t *data, size_t length) {
+    size_t count = _txLength < length ? _txLength : length;
+    memcpy(data, _tx, count);
+    memmove(_tx, _tx + count, _txLength - count);
+    _txLength -= count;
+    return count;
+}
+
+NativeSerial Serial(true);
+NativeSerial Serial1(false);
+NativeSerial Serial5(false);
@@ -0,0 +1,157 @@
+/*"""
+
+ Native Arduino:
+ Desktop stand-in for the parts of the Teensy Arduino core the lamp firmware uses, so the render loop,
+ the effects and SerialHandler can run and be benchmarked on Linux ([env:native], [env:native_bench]).
+
+ Time comes from a controllable clock. In virtual mode (the default) it only moves when
+ nativeAdvanceMicros()/nativeSetMicros() are called, so runs are reproducible and can simulate hours
+ of animation in seconds. nativeUseRealtime(true) switches to the host's steady clock.
+ ARM_DWT_CYCCNT is emulated from the host's steady clock at F_CPU_ACTUAL.
+
+"""*/
+#ifndef NativeArduino_H
+#define NativeArduino_H
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define DMAMEM
+#define FASTRUN
+#define PROGMEM
+#define LED_BUILTIN 13
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LOW 0
+#define HIGH 1
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define DEC 10
+#define HEX 16
+
+#define F_CPU_ACTUAL 600000000UL
+#define ARM_DWT_CYCCNT (nativeCycleCount())
+
+// Mixed argument types are allowed like with the Teensy core's min()/max()
+template <class A, class B>
+constexpr typename std::common_type<A, B>::type min(A a, B b) { return a < b ? a : b; }
+template <class A, class B>
+constexpr typename std::common_type<A, B>::type max(A a, B b) { return a > b ? a : b; }
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Clock
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+uint32_t nativeCycleCount();
+void nativeUseRealtime(bool realtime);
+void nativeSetMicros(uint64_t us);
+void nativeAdvanceMicros(uint64_t us);
+uint64_t nativeMicros();
+
+// Same ranges as the Arduino core: random(max) is [0, max), random(min, max) is [min, max)
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t) { return LOW; }
+inline void analogWrite(uint8_t, int) {}
+inline int digitalPinToInterrupt(uint8_t pin) { return pin; }
+inline void attachInterrupt(uint8_t, void (*)(void), int) {}
+inline void __disable_irq() {}
+inline void __enable_irq() {}
+inline void yield() {}
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+        size_t count = 0;
+        while (size--)
+            count += write(*buffer++);
+        return count;
+    }
+    size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+    virtual int availableForWrite() { return 4096; }
+    virtual void flush() {}
+
+    size_t print(const char *s) { return write(s); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(int n, int base = DEC) { return print((long)n, base); }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+    size_t print(double n, int digits = 2);
+    size_t println() { return write("\r\n"); }
+    template <typename Type>
+    size_t println(Type value) { return print(value) + println(); }
+    template <typename Type>
+    size_t println(Type value, int format) { return print(value, format) + println(); }
+    int printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+/*"""
+ Serial port stand-in. Everything written goes to stdout (unless muted) and can also be captured.
+ Received bytes are queued with inject().
+"""*/
+class NativeSerial : public Stream {
+public:
+    explicit NativeSerial(bool echo) : _echo(echo) {}
+    void begin(unsigned long) {}
+    void end() {}
+    operator bool() { return true; }
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int available() override { return _rxLength - _rxIndex; }
+    int read() override { return _rxIndex < _rxLength ? _rx[_rxIndex++] : -1; }
+    int peek() override { return _rxIndex < _rxLength ? _rx[_rxIndex] : -1; }
+
+    void setEcho(bool echo) { _echo = echo; }
+    void inject(const uint8_t *data, size_t length);
+    void setCapture(bool capture) { _capture = capture; }
+    size_t captured(uint8_t *data, size_t length);
+    uint32_t getBytesWritten() { return _bytesWritten; }
+
+private:
+    static const size_t _bufferSize = 4096;
+    bool _echo;
+    bool _capture = false;
+    uint8_t _rx[_bufferSize];
+    size_t _rxIndex = 0;
+    size_t _rxLength = 0;
+    uint8_t _tx[_bufferSize];
+    size_t _txLength = 0;
+    uint32_t _bytesWritten = 0;
+};
+
+extern NativeSerial Serial;
+extern NativeSerial Serial1;
+extern NativeSerial Serial5;
+
+#endif
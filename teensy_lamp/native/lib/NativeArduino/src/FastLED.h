@@ -0,0 +1,175 @@
+/*"""
+
+ Native stand-in for the FastLED color math the lamp uses: CRGB/CHSV, scale8, scale8_video, qadd8/qsub8,
+ blend8, the CRGB scaling and blending helpers and hsv2rgb_rainbow. Same results as FastLED 3.7 with its
+ defaults (FASTLED_SCALE8_FIXED and FASTLED_BLEND_FIXED), in plain C++ instead of AVR/ARM assembly.
+ No controllers, no FastLED.show(): the lamp sends its frames through OctoWS2811.
+
+"""*/
+#ifndef NativeFastLED_H
+#define NativeFastLED_H
+#include "Arduino.h"
+
+typedef uint8_t fract8;
+
+inline uint8_t scale8(uint8_t i, fract8 scale) { return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8; }
+// Never scales a lit channel down to 0
+inline uint8_t scale8_video(uint8_t i, fract8 scale) { return (((uint16_t)i * scale) >> 8) + ((i && scale) ? 1 : 0); }
+inline uint8_t qadd8(uint8_t i, uint8_t j) { return i + j > 255 ? 255 : i + j; }
+inline uint8_t qsub8(uint8_t i, uint8_t j) { return i > j ? i - j : 0; }
+inline uint8_t blend8(uint8_t a, uint8_t b, uint8_t amountOfB) {
+    uint16_t partial = (a << 8) | b;
+    partial += b * amountOfB;
+    partial -= a * amountOfB;
+    return partial >> 8;
+}
+
+struct CHSV {
+    union {
+        struct {
+            uint8_t hue;
+            uint8_t sat;
+            uint8_t val;
+        };
+        uint8_t raw[3];
+    };
+    CHSV() = default;
+    CHSV(uint8_t ih, uint8_t is, uint8_t iv) : hue(ih), sat(is), val(iv) {}
+};
+
+struct CRGB {
+    union {
+        struct {
+            uint8_t r;
+            uint8_t g;
+            uint8_t b;
+        };
+        uint8_t raw[3];
+    };
+
+    typedef enum { Black = 0x000000, Blue = 0x0000FF, Green = 0x008000, Red = 0xFF0000, White = 0xFFFFFF } HTMLColorCode;
+
+    CRGB() = default;
+    // constexpr like FastLED's own, so colors can be built into tables at compile time
+    constexpr CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+    constexpr CRGB(uint32_t colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+    constexpr CRGB(HTMLColorCode colorcode) : CRGB((uint32_t)colorcode) {}
+    CRGB(const CHSV &hsv);
+
+    uint8_t &operator[](uint8_t x) { return raw[x]; }
+    const uint8_t &operator[](uint8_t x) const { return raw[x]; }
+
+    CRGB &addToRGB(uint8_t d) {
+        r = qadd8(r, d);
+        g = qadd8(g, d);
+        b = qadd8(b, d);
+        return *this;
+    }
+    CRGB &subtractFromRGB(uint8_t d) {
+        r = qsub8(r, d);
+        g = qsub8(g, d);
+        b = qsub8(b, d);
+        return *this;
+    }
+    CRGB &nscale8(uint8_t scale) {
+        r = scale8(r, scale);
+        g = scale8(g, scale);
+        b = scale8(b, scale);
+        return *this;
+    }
+    CRGB &nscale8_video(uint8_t scale) {
+        r = scale8_video(r, scale);
+        g = scale8_video(g, scale);
+        b = scale8_video(b, scale);
+        return *this;
+    }
+    CRGB &operator+=(const CRGB &rhs) {
+        r = qadd8(r, rhs.r);
+        g = qadd8(g, rhs.g);
+        b = qadd8(b, rhs.b);
+        return *this;
+    }
+    explicit operator bool() const { return r || g || b; }
+};
+
+inline bool operator==(const CRGB &lhs, const CRGB &rhs) { return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b; }
+inline bool operator!=(const CRGB &lhs, const CRGB &rhs) { return !(lhs == rhs); }
+
+// FastLED's "rainbow" hue wheel: 8 sections of 32 hues with a wider yellow than a plain spectrum
+inline void hsv2rgb_rainbow(const CHSV &hsv, CRGB &rgb) {
+    uint8_t hue = hsv.hue;
+    uint8_t sat = hsv.sat;
+    uint8_t val = hsv.val;
+    uint8_t offset8 = (hue & 0x1F) << 3;
+    uint8_t third = scale8(offset8, 256 / 3);
+    uint8_t twothirds = scale8(offset8, 256 * 2 / 3);
+    uint8_t r, g, b;
+    switch (hue >> 5) {
+    case 0: // red to orange
+        r = 255 - third, g = third, b = 0;
+        break;
+    case 1: // orange to yellow
+        r = 171, g = 85 + third, b = 0;
+        break;
+    case 2: // yellow to green
+        r = 171 - twothirds, g = 170 + third, b = 0;
+        break;
+    case 3: // green to aqua
+        r = 0, g = 255 - third, b = third;
+        break;
+    case 4: // aqua to blue
+        r = 0, g = 171 - twothirds, b = 85 + twothirds;
+        break;
+    case 5: // blue to purple
+        r = third, g = 0, b = 255 - third;
+        break;
+    case 6: // purple to pink
+        r = 85 + third, g = 0, b = 171 - third;
+        break;
+    default: // pink to red
+        r = 170 + third, g = 0, b = 85 - third;
+        break;
+    }
+    if (sat != 255) {
+        if (sat == 0) {
+            r = g = b = 255;
+        } else {
+            uint8_t desat = scale8_video(255 - sat, 255 - sat);
+            uint8_t satscale = 255 - desat;
+            r = scale8(r, satscale) + desat;
+            g = scale8(g, satscale) + desat;
+            b = scale8(b, satscale) + desat;
+        }
+    }
+    if (val != 255) {
+        val = scale8_video(val, val);
+        r = scale8(r, val);
+        g = scale8(g, val);
+        b = scale8(b, val);
+    }
+    rgb = CRGB(r, g, b);
+}
+
+inline CRGB::CRGB(const CHSV &hsv) { hsv2rgb_rainbow(hsv, *this); }
+
+inline CRGB blend(const CRGB &p1, const CRGB &p2, fract8 amountOfP2) {
+    return CRGB(blend8(p1.r, p2.r, amountOfP2), blend8(p1.g, p2.g, amountOfP2), blend8(p1.b, p2.b, amountOfP2));
+}
+
+inline CRGB *blend(const CRGB *src1, const CRGB *src2, CRGB *dest, uint16_t count, fract8 amountOfsrc2) {
+    for (uint16_t i = 0; i < count; i++)
+        dest[i] = blend(src1[i], src2[i], amountOfsrc2);
+    return dest;
+}
+
+inline void nscale8_video(CRGB *leds, uint16_t num_leds, uint8_t scale) {
+    for (uint16_t i = 0; i < num_leds; i++)
+        leds[i].nscale8_video(scale);
+}
+
+inline void fill_solid(CRGB *leds, int numToFill, const CRGB &color) {
+    for (int i = 0; i < numToFill; i++)
+        leds[i] = color;
+}
+
+#endif
@@ -0,0 +1,94 @@
+/*"""
+
+ Native stand-in for OctoWS2811. Keeps the same drawing memory layout as the Teensy 4 library
+ (3 bytes per pixel in wire order), copies it to the display memory on show() and reports busy()
+ for as long as the frame would take on the wire at 800 kHz, measured on the native clock.
+
+"""*/
+#ifndef NativeOctoWS2811_H
+#define NativeOctoWS2811_H
+#include "Arduino.h"
+
+#define WS2811_RGB 0
+#define WS2811_RBG 1
+#define WS2811_GRB 2
+#define WS2811_GBR 3
+#define WS2811_BRG 4
+#define WS2811_BGR 5
+#define WS2811_800kHz 0x00
+#define WS2811_400kHz 0x10
+#define WS2813_800kHz 0x20
+
+class OctoWS2811 {
+public:
+    OctoWS2811(uint32_t numPerStrip, void *frameBuf, void *drawBuf, uint8_t config = WS2811_GRB, uint8_t numPins = 8, const uint8_t *pinList = nullptr)
+        : _stripLength(numPerStrip), _frameBuffer((uint8_t *)frameBuf), _drawBuffer((uint8_t *)drawBuf), _params(config), _numPins(numPins) {}
+
+    void begin() {}
+    void show() {
+        while (busy())
+            ;
+        memcpy(_frameBuffer, _drawBuffer, numPixels() * 3);
+        _showTime = micros();
+        _shows++;
+    }
+    // One pixel is 24 bits at 1.25 us, every pin clocks out its strip in parallel, plus the 300 us latch.
+    // Every poll while busy costs a microsecond, so code spinning on busy() also ends on the virtual clock.
+    int busy() {
+        if (_shows == 0 || micros() - _showTime >= getWireTime())
+            return 0;
+        delayMicroseconds(1);
+        return 1;
+    }
+    uint32_t getWireTime() { return _stripLength * 30 + 300; }
+
+    void setPixel(uint32_t num, int color) {
+        color = _toWireOrder(color);
+        uint8_t *dest = _drawBuffer + num * 3;
+        dest[0] = color >> 16;
+        dest[1] = color >> 8;
+        dest[2] = color;
+    }
+    void setPixel(uint32_t num, uint8_t red, uint8_t green, uint8_t blue) { setPixel(num, Color(red, green, blue)); }
+    void setPixelColor(uint32_t num, int color) { setPixel(num, color); }
+    void setPixelColor(uint32_t num, uint8_t red, uint8_t green, uint8_t blue) { setPixel(num, red, green, blue); }
+    int getPixel(uint32_t num) {
+        const uint8_t *src = _drawBuffer + num * 3;
+        return _fromWireOrder((src[0] << 16) | (src[1] << 8) | src[2]);
+    }
+
+    int numPixels() { return _stripLength * _numPins; }
+    int Color(uint8_t red, uint8_t green, uint8_t blue) { return (red << 16) | (green << 8) | blue; }
+
+    // Native only: what the strip currently shows
+    const uint8_t *getDisplayMemory() { return _frameBuffer; }
+    uint32_t getShows() { return _shows; }
+
+private:
+    // Byte position of red, green and blue for each WS2811 color order
+    static int _order(uint8_t params, int channel) {
+        static const uint8_t offsets[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {2, 0, 1}, {1, 2, 0}, {2, 1, 0}};
+        return offsets[(params & 7) > 5 ? 0 : params & 7][channel];
+    }
+    int _toWireOrder(int color) {
+        uint8_t bytes[3];
+        bytes[_order(_params, 0)] = color >> 16;
+        bytes[_order(_params, 1)] = color >> 8;
+        bytes[_order(_params, 2)] = color;
+        return (bytes[0] << 16) | (bytes[1] << 8) | bytes[2];
+    }
+    int _fromWireOrder(int wire) {
+        uint8_t bytes[3] = {(uint8_t)(wire >> 16), (uint8_t)(wire >> 8), (uint8_t)wire};
+        return (bytes[_order(_params, 0)] << 16) | (bytes[_order(_params, 1)] << 8) | bytes[_order(_params, 2)];
+    }
+
+    uint32_t _stripLength;
+    uint8_t *_frameBuffer;
+    uint8_t *_drawBuffer;
+    uint8_t _params;
+    uint8_t _numPins;
+    uint32_t _showTime = 0;
+    uint32_t _shows = 0;
+};
+
+#endif
@@ -0,0 +1,5 @@
+// Native stand-in, nothing to declare
+#ifndef NativeSPI_H
+#define NativeSPI_H
+#include "Arduino.h"
+#endif
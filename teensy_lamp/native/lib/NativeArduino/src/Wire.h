@@ -0,0 +1,5 @@
+// Native stand-in, nothing to declare
+#ifndef NativeWire_H
+#define NativeWire_H
+#include "Arduino.h"
+#endif
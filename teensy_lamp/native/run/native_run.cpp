@@ -0,0 +1,78 @@
+// Headless host run of the lamp firmware ([env:native]).
+// Calls the unmodified setup()/loop() from src/main.cpp on the virtual clock and prints what the
+// strip would have shown. The mode is set the same way the ESP32 does it, with a STATE frame on Serial5.
+// With a fade time, a second STATE halfway through fades into the next mode over that many ms.
+//
+//   pio run -e native && .pio/build/native/program [mode] [seconds] [fade ms]
+#include "Effects.h"
+#include "LampProtocol.h"
+#include <Arduino.h>
+#include <OctoWS2811.h>
+
+void setup();
+void loop();
+extern OctoWS2811 leds;
+
+// Host time spent per loop() pass on the virtual clock, about what one pass takes on the Teensy
+static const uint32_t LOOP_STEP_US = 100;
+
+int main(int argc, char **argv) {
+    LampState state = {255, 128, 0, 0, 150};
+    if (argc > 1)
+        state.mode = atoi(argv[1]);
+    uint32_t seconds = argc > 2 ? atoi(argv[2]) : 10;
+    uint32_t fade = argc > 3 ? atoi(argv[3]) : 0;
+
+    randomSeed(1);
+    setup();
+
+    uint8_t frame[LampProtocol::MAX_FRAME];
+    uint8_t frameLength = LampProtocol::encodeState(state, 1, frame);
+    Serial5.inject(frame, frameLength);
+    Serial5.setCapture(true);
+
+    uint64_t end = nativeMicros() + seconds * 1000000ULL;
+    uint64_t halfway = nativeMicros() + seconds * 500000ULL;
+    uint32_t passes = 0;
+    while (nativeMicros() < end) {
+        if (fade && nativeMicros() >= halfway) {
+            LampState next = state;
+            next.mode = (state.mode + 1) % getEffectCount();
+            next.fade = fade;
+            frameLength = LampProtocol::encodeState(next, 2, frame);
+            Serial5.inject(frame, frameLength);
+            printf("fading into mode %u over %u ms\n", next.mode, fade);
+            fade = 0;
+        }
+        loop();
+        nativeAdvanceMicros(LOOP_STEP_US);
+        passes++;
+    }
+
+    const char query[] = "<P0>";
+    Serial5.inject((const uint8_t *)query, sizeof(query) - 1);
+    loop();
+
+    // ACK frames and the plain text profiler report are interleaved on the same port
+    uint8_t reply[1024];
+    size_t replyLength = Serial5.captured(reply, sizeof(reply));
+    bool acked = false;
+    LampProtocol decoder;
+    printf("\n");
+    for (size_t i = 0; i < replyLength; i++) {
+        bool inFrame = decoder.isReceiving() || reply[i] == LampProtocol::SYNC;
+        if (decoder.feed(reply[i]) && decoder.getType() == LAMP_MSG_ACK)
+            acked = true;
+        else if (!inFrame)
+            putchar(reply[i]);
+    }
+
+    const uint8_t *display = leds.getDisplayMemory();
+    printf("mode %u, %u s simulated, %u loop passes, %u frames shown (%.1f/s), state %s\n", state.mode, seconds, passes,
+           leds.getShows(), leds.getShows() / (float)seconds, acked ? "acked" : "NOT acked");
+    printf("first pixels on the wire:");
+    for (int i = 0; i < 8; i++)
+        printf(" %02X%02X%02X", display[i * 3], display[i * 3 + 1], display[i * 3 + 2]);
+    printf("\n");
+    return acked ? 0 : 1;
+}
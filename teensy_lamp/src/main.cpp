@@ -1,6 +1,12 @@
 // Main code for the cloud LED lamp project
 // Cycle between different modes of LED lighting based on touch input
+#include "Effects.h"
+#include "FrameProfiler.h"
+#include "FrameScheduler.h"
+#include "LedPositions.h"
+#include "OutputStage.h"
 #include "SerialHandler.h"
+#include "Transition.h"
 #include <Adafruit_CAP1188.h>
 #include <Arduino.h>
 #include <OctoWS2811.h>
@@ -8,41 +14,75 @@
 #include <Wire.h>
 
 SerialHandler SH;
+// USB serial log, written out only when the loop is idle
+advancedLogger logger;
 
 #define LED_COUNT 247 //248
 
-const int numPins = 1;
+// Physical wiring: the part of the logical strip each pin drives, see LedLayout.h. All pins are clocked out
+// in parallel, so splitting the strip over N pins cuts the wire time per frame to about 1/N. Two pins:
+//   byte pinList[numPins] = {7, 8};
+//   constexpr StripRun wiring[numPins] = {{0, 124, false}, {124, 123, true}};
+constexpr int numPins = 1;
 byte pinList[numPins] = {7};
+constexpr StripRun wiring[numPins] = {{0, LED_COUNT, false}};
 
-const int ledsPerStrip = LED_COUNT;
+static_assert(LED_COUNT <= EFFECTS_MAX_LEDS, "EFFECTS_MAX_LEDS in platformio.ini has to cover every LED");
+
+// Effects address LEDs 0..LED_COUNT-1 in logical order, the output stage packs them to their pin
+static constexpr LedMap<LED_COUNT> ledMap(wiring, numPins);
+static_assert(ledMap.valid, "the wiring has to put every LED on exactly one pin");
+
+const int ledsPerStrip = ledMap.ledsPerStrip;
 
 const int bytesPerLED = 3;
-DMAMEM int displayMemory[ledsPerStrip * numPins * bytesPerLED / 4];
-int drawingMemory[ledsPerStrip * numPins * bytesPerLED / 4];
+// Rounded up to whole ints, the last pixel must not end past the buffer
+DMAMEM int displayMemory[(ledsPerStrip * numPins * bytesPerLED + 3) / 4];
+int drawingMemory[(ledsPerStrip * numPins * bytesPerLED + 3) / 4];
 
 const int config = WS2811_GRB | WS2811_800kHz;
 
 OctoWS2811 leds(ledsPerStrip, displayMemory, drawingMemory, config, numPins, pinList);
 
-enum LedMode { THUNDER,
-               SUNLIGHT,
-               RAINBOW,
-               COLOR,
-};
-
-LedMode ledMode = THUNDER;
+// Logical framebuffer the effects draw into. Brightness is only applied by the output stage.
+CRGB frame[LED_COUNT];
+OutputStage output;
+FrameProfiler profiler;
+
+LedBuffer buffer = {frame, LED_COUNT};
+// Where every logical LED sits in the cloud plus a grid for radius queries, both generated at compile time
+static_assert(CLOUD_LED_COUNT == LED_COUNT, "LedPositions.h has to describe every LED");
+static constexpr LedSpaceTable<LED_COUNT> cloudTable PROGMEM = LedSpaceTable<LED_COUNT>(cloudPosition);
+const LedSpace cloud(cloudTable);
+FrameScheduler scheduler;
+// Sampled once per rendered frame, effects only see this time
+FrameClock frameClock;
+
+// Current effect, see the registry in Effects.h for the modes
+uint8_t ledMode = 0;
+Effect *effect = nullptr;
+// Fades between effects, colors and brightness levels, each side renders into its own buffer
+CRGB fadeFrom[LED_COUNT];
+CRGB fadeTo[LED_COUNT];
+Transition transition;
 unsigned long lastModeChangeTime = 0;
 const unsigned long modeChangeCooldown = 1000; // 1 second cooldown
 unsigned long lastTouchTime = 0;
 const unsigned long touchBufferTime = 5000; // 200 ms cooldown
 
-void updateThunderMode();
-void updateSunlightMode(uint32_t color);
-void updateRainbowMode();
-void updateBrightness();
+void selectEffect(uint8_t mode);
+void changeState(uint8_t mode, uint8_t brightness, uint32_t color, uint32_t fade);
+void renderFrame();
+void showFrame();
+void showPending();
+void ditherFrame();
+void reportStats(SerialHandler &handler, uint32_t reset);
+uint32_t measureLegacyBrightnessCycles();
 
 // Add this near the top of the file, with other global variables
-float globalBrightness = 150;          // Current brightness level
+uint8_t globalBrightness = 150;        // Current brightness level
+uint8_t targetBrightness = 150;        // Where globalBrightness ends up once a fade is done
+uint32_t stripColor = 0;               // Color of the color effect
 const int maxBrightness = 255;         // Maximum brightness level
 const int minBrightness = 0;           // Minimum brightness level
 const float brightnessIncrement = 0.5; // Amount to change brightness
@@ -54,228 +94,213 @@ void setup() {
     Serial5.begin(115200);
 
     SH.setSerial(Serial5);
+    SH.setStatsQuery(reportStats);
+    logger.setPrinter(Serial);
 
     leds.begin();
     leds.show();
+    output.begin(leds, drawingMemory, LED_COUNT, config);
+    output.setLayout(ledMap.physical);
+    profiler.begin();
+    transition.begin(fadeFrom, fadeTo);
+    // Lightning, rainbow and clouds across the lamp instead of along the strip
+    thunderEffect.setSpace(&cloud);
+    rainbowEffect.setSpace(&cloud);
+    cloudEffect.setSpace(&cloud);
+    selectEffect(ledMode);
+
+    // One-shot comparison of the old save/scale/restore brightness pass against the fused output stage
+    uint32_t legacyCycles = measureLegacyBrightnessCycles();
+    output.write(frame);
+    logger.v().p("Brightness pass: legacy ").p(legacyCycles).p(" cycles, output stage ").p(output.getCycles()).p(" cycles").ln().send();
 }
 
 void loop() {
-    analogWrite(LED_BUILTIN, millis() % 1000 < 500 ? 100 : 0);
+    // One time for everything in this pass that is not an effect
+    uint32_t now = millis();
+    analogWrite(LED_BUILTIN, now % 1000 < 500 ? 100 : 0);
 
+    profiler.start(PROFILE_SERIAL);
     SH.update();
-
-    globalBrightness = max(SH.b, max(SH.g, SH.r));
-    ledMode = (LedMode)SH.mode;
-
-    switch (ledMode) {
-    case THUNDER:
-        updateThunderMode();
-        break;
-    case SUNLIGHT:
-        updateSunlightMode(leds.Color(255, 128, 0));
-        break;
-    case RAINBOW:
-        updateRainbowMode();
-        break;
-    case COLOR:
-        updateSunlightMode(leds.Color(SH.r, SH.g, SH.b));
-        break;
+    profiler.stop(PROFILE_SERIAL);
+
+    // A state from the ESP32 can come with a fade time, everything else switches at once
+    uint8_t mode = getEffect(SH.mode) ? SH.mode : ledMode;
+    uint32_t color = packColor(SH.r, SH.g, SH.b);
+    if (mode != ledMode || SH.brightness != targetBrightness || color != stripColor)
+        changeState(mode, SH.brightness, color, SH.fade);
+    if (effect->isDirty())
+        scheduler.markDirty();
+
+    // Hand the packed frame to the DMA as soon as the previous transfer is done, without blocking the loop
+    if (output.isPending() && !output.isBusy())
+        showPending();
+    // Dimmed levels between two steps need a new dither pattern on every frame the strip can take while the
+    // frames are changing, independent of the effect's frame rate
+    else if (output.isDithering() && !output.isBusy())
+        ditherFrame();
+
+    if (scheduler.frameDue())
+        renderFrame();
+    else
+        logger.drain(); // Nothing to render on this pass, flush the log
+
+    static uint32_t printTimer = 0;
+    if (now - printTimer > 100) {
+        printTimer = now;
+        const uint32_t cyclesPerMicro = F_CPU_ACTUAL / 1000000;
+        ADVANCED_LOG(logger, vv).p("R: ").p(SH.r).p(", G: ").p(SH.g).p(", B: ").p(SH.b).p(", Mode: ").p(SH.mode).ln().send();
+        ADVANCED_LOG(logger, vv).p("Frame: ").p(profiler.getLast(PROFILE_FRAME)).p(" cyc, Output: ").p(output.getCycles()).p(" cyc, FPS: ").p(scheduler.getFps(), 1).p(", Shown: ").p(scheduler.getShownFps(), 1)
+            .p(", Skipped: ").p(scheduler.getSkippedFrames()).p(", Wait: ").p(output.getWaitCycles() / cyclesPerMicro).p(" us (max ").p(output.getMaxWaitCycles() / cyclesPerMicro).p(" us)").ln().send();
+        output.resetWaitStats();
     }
-    updateBrightness();
 
-    static long printTimer = 0;
-    if (millis() - printTimer > 100) {
-        printTimer = millis();
-        Serial.printf("R: %3d, G: %3d, B: %3d, Mode: %3d\n", SH.r, SH.g, SH.b, SH.mode);
+    static uint32_t linkTimer = 0;
+    if (now - linkTimer > 1000) {
+        linkTimer = now;
+        LampProtocol &link = SH.getProtocol();
+        logger.v().p("Link: ").p(SH.getBytesPerSecond(), 0).p(" B/s, ").p(SH.getMessagesPerSecond(), 1).p(" msg/s, overflows ").p(SH.getOverflows())
+            .p(", rejected ").p(SH.getRejectedMessages()).p(", frames ").p(link.getFrames()).p(", CRC errors ").p(link.getCrcErrors()).p(", length errors ").p(link.getLengthErrors()).ln().send();
+        logger.v().p("Sync: seq ").p(SH.getAppliedSequence()).p(", acks ").p(SH.getAcksSent()).p(", retransmits ").p(SH.getDuplicateStates())
+            .p(", age ").p(SH.getLinkAge()).p(" ms, log dropped ").p(logger.getDropped()).ln().send();
     }
 }
 
-// Base values for thunder effect parameters
-const uint32_t BACKGROUND_BLUE = leds.Color(0, 0, 50);
-uint32_t lightningColor = leds.Color(255, 255, 255);
-const int THUNDER_CHANCE = 10;
-const unsigned long LIGHTNING_DURATION = 50;
-const unsigned long LAST_FLASH_DURATION = 200;
-const unsigned long FLASH_INTERVAL = 100;
-const unsigned long FADE_INTERVAL = 10;
-const unsigned long LIGHTNING_COOLDOWN = 10000;
-const int MAX_LIGHTNING_LENGTH = LED_COUNT / 8;
-const int MIN_FLASHES = 1;
-const int MAX_FLASHES = 6;
-
-unsigned long lastLightningTime = 0;
-unsigned long lastFlashTime = 0;
-unsigned long lastFadeTime = 0;
-bool isLightningSequence = false;
-int currentFlash = 0;
-int totalFlashes = 0;
-int lightningStart = 0;
-int lightningLength = 0;
-int fadingIndex = 0;
-
-void updateThunderMode() {
-    unsigned long currentTime = millis();
-
-    // Check if we're currently in a lightning sequence
-    if (isLightningSequence) {
-        if (currentFlash < totalFlashes) {
-            unsigned long flashDuration = (currentFlash == totalFlashes - 1) ? LAST_FLASH_DURATION + random(-50, 51) : LIGHTNING_DURATION + random(-10, 11);
-
-            // Flash on
-            if (currentTime - lastFlashTime < flashDuration) {
-                for (int i = lightningStart; i < lightningStart + lightningLength; i++) {
-                    leds.setPixelColor(i % LED_COUNT, lightningColor);
-                }
-            }
-            // Flash off (only for non-last flashes)
-            else if (currentFlash < totalFlashes - 1 && currentTime - lastFlashTime < FLASH_INTERVAL + random(-20, 21)) {
-                for (int i = lightningStart; i < lightningStart + lightningLength; i++) {
-                    leds.setPixelColor(i % LED_COUNT, BACKGROUND_BLUE);
-                }
-            }
-            // Start next flash
-            else if (currentFlash < totalFlashes - 1) {
-                currentFlash++;
-                lastFlashTime = currentTime;
-            }
-            // End of last flash
-            else if (currentTime - lastFlashTime >= flashDuration) {
-                isLightningSequence = false;
-                fadingIndex = 0;
-                lastFadeTime = currentTime;
-            }
-        }
-        return; // Skip the rest of the function during lightning sequence
-    }
+// Switch to the effect of a mode at once. The other effects keep their state for when they come back.
+void selectEffect(uint8_t mode) {
+    if (effect)
+        effect->end();
+    ledMode = mode;
+    effect = getEffect(mode);
+    effect->begin(buffer);
+    effect->markDirty();
+    scheduler.setFrameInterval(effect->getFrameInterval());
+    scheduler.setStatic(effect->isStatic());
+    scheduler.markDirty();
+}
 
-    // Fading logic
-    if (fadingIndex < lightningLength) {
-        if (currentTime - lastFadeTime >= FADE_INTERVAL + random(-5, 6)) {
-            int fadePos = (lightningStart + fadingIndex) % LED_COUNT;
-            leds.setPixelColor(fadePos, BACKGROUND_BLUE);
-            fadingIndex++;
-            lastFadeTime = currentTime;
-        }
-        return; // Skip the rest of the function while fading
+// Go to a new mode, brightness and color, blended over fade ms. A change nobody would see is applied at once.
+void changeState(uint8_t mode, uint8_t brightness, uint32_t color, uint32_t fade) {
+    Effect *next = getEffect(mode);
+    bool visible = transition.isActive() || next != effect || brightness != globalBrightness ||
+                   (next == &colorEffect && color != stripColor);
+    stripColor = color;
+    targetBrightness = brightness;
+    if (fade > 0 && visible) {
+        transition.start(effect, next, globalBrightness, brightness, fade, buffer);
+        ledMode = mode;
+        effect = next;
+        colorEffect.setColor(color);
+        scheduler.setFrameInterval(transition.getFrameInterval());
+        scheduler.setStatic(false);
+        scheduler.markDirty();
+        return;
     }
-
-    // Set all LEDs to the background blue color
-    for (int i = 0; i < LED_COUNT; i++) {
-        leds.setPixelColor(i, BACKGROUND_BLUE);
+    if (transition.isActive()) {
+        // Drop the rest of the fade, the current effect goes on from its own frame, not the blended one
+        transition.cancel(buffer);
+        effect->markDirty();
+        scheduler.setFrameInterval(effect->getFrameInterval());
+        scheduler.setStatic(effect->isStatic());
     }
-
-    // Randomly generate lightning
-    if (currentTime - lastLightningTime >= LIGHTNING_COOLDOWN + random(-5000, 5001) &&
-        random(100) < THUNDER_CHANCE) {
-        // Start a new lightning sequence
-        isLightningSequence = true;
-        currentFlash = 0;
-        totalFlashes = random(MIN_FLASHES, MAX_FLASHES + 1); // Random number of flashes
-        lastFlashTime = currentTime;
-        lastLightningTime = currentTime;
-
-        // Determine random start and length for lightning
-        lightningStart = random(LED_COUNT);
-        lightningLength = random(1, MAX_LIGHTNING_LENGTH + 1);
-        // Slightly vary from white
-        lightningColor = leds.Color(235, 235, 235);
-        uint8_t r = (lightningColor >> 16) & 0xFF;
-        uint8_t g = (lightningColor >> 8) & 0xFF;
-        uint8_t b = lightningColor & 0xFF;
-        r += random(-20, 21);
-        g += random(-20, 21);
-        b += random(-20, 21);
-        lightningColor = leds.Color(r, g, b);
+    if (next != effect)
+        selectEffect(mode);
+    colorEffect.setColor(color);
+    if (brightness != globalBrightness) {
+        globalBrightness = brightness;
+        scheduler.markDirty();
     }
+}
 
-    // Add some subtle variation to the background
-    for (int i = 0; i < LED_COUNT; i++) {
-        if (random(100) < 20) { // 5% chance to slightly vary each LED
-            int variation = random(-15, 16);
-            uint32_t color = leds.Color(0, 0, max(0, min(255, 50 + variation)));
-            leds.setPixelColor(i, color);
+// Render one frame of the current effect, or of the transition into it. Called once per scheduler tick.
+void renderFrame() {
+    profiler.start(PROFILE_FRAME);
+    profiler.start(PROFILE_EFFECT);
+    if (transition.isActive()) {
+        bool fading = transition.render(frameClock.tick(), buffer);
+        globalBrightness = transition.getBrightness();
+        if (!fading) {
+            scheduler.setFrameInterval(effect->getFrameInterval());
+            scheduler.setStatic(effect->isStatic());
         }
+    } else {
+        effect->render(frameClock.tick(), buffer);
     }
+    effect->clearDirty();
+    profiler.stop(PROFILE_EFFECT);
+    // Nothing changed since the last shown frame, leave the strip and the DMA alone. Dithering only runs while
+    // frames keep changing, a frame that stays goes out once more on its rounded levels and is not re-sent.
+    bool changed = scheduler.present(FrameScheduler::hashFrame(frame, LED_COUNT, globalBrightness));
+    if (changed || output.isDithering()) {
+        output.setDithering(changed && (transition.isActive() || !effect->isStatic()));
+        showFrame();
+    }
+    profiler.stop(PROFILE_FRAME);
 }
 
-void updateSunlightMode(uint32_t clr = leds.Color(255, 128, 0)) {
-    static long flickerTimer = 50;
-    if (millis() - flickerTimer <= 1)
-        return;
-    flickerTimer = millis();
-
-    // Set the brightness of each LED to a warmer orange color with flickering effect
-    for (int i = 0; i < LED_COUNT; i++) {
-        int flicker = random(-10, 11);
-
-        int r1 = (clr >> 16) & 0xFF;
-        int g1 = (clr >> 8) & 0xFF;
-        int b1 = clr & 0xFF;
-
-        uint8_t r = constrain(r1 + flicker, 0, 255);
-        uint8_t g = constrain(g1 + flicker, 0, 255);
-        uint8_t b = constrain(b1 + flicker, 0, 255);
+// Scale the logical frame by the global brightness straight into the drawing memory and send it out.
+// The effect for this frame was computed while the previous one was still clocking out.
+void showFrame() {
+    // Hand-off point: a frame that is still waiting for the DMA has to go out before it is overwritten
+    if (output.isPending())
+        showPending();
+    profiler.start(PROFILE_OUTPUT);
+    output.setBrightness(globalBrightness);
+    output.write(frame);
+    profiler.stop(PROFILE_OUTPUT);
+    if (!output.isBusy())
+        showPending();
+}
 
-        leds.setPixelColor(i, r, g, b); // Warmer orange sunlight effect
-    }
+// Send the last frame again with the next dither thresholds
+void ditherFrame() {
+    profiler.start(PROFILE_OUTPUT);
+    output.write(frame);
+    profiler.stop(PROFILE_OUTPUT);
+    showPending();
 }
 
-// Function to convert a hue value to a color
-uint32_t Wheel(byte WheelPos) {
-    WheelPos = 255 - WheelPos; // Reverse the wheel for a different effect
-    if (WheelPos < 85) {
-        return leds.Color(255 - WheelPos * 3, 0, WheelPos * 3); // Red to Green
-    } else if (WheelPos < 170) {
-        WheelPos -= 85;
-        return leds.Color(0, WheelPos * 3, 255 - WheelPos * 3); // Green to Blue
-    } else {
-        WheelPos -= 170;
-        return leds.Color(WheelPos * 3, 255 - WheelPos * 3, 0); // Blue to Red
-    }
+void showPending() {
+    profiler.start(PROFILE_SHOW);
+    output.show();
+    profiler.stop(PROFILE_SHOW);
 }
-void updateRainbowMode() {
-    static uint32_t lastUpdateTime = 0; // Last time the rainbow was updated
-    static int hue = 0;                 // Current hue value for the rainbow effect
-    const int speed = 5;                // Speed of the rainbow transition
-
-    // Update the rainbow effect every few milliseconds
-    if (millis() - lastUpdateTime > 20) {
-        lastUpdateTime = millis();
-
-        // Set each LED to the current hue
-        for (int i = 0; i < LED_COUNT; i++) {
-            // Calculate the color based on the current hue and LED index
-            uint32_t color = Wheel((hue + (i * 256 / LED_COUNT)) & 255);
-            leds.setPixelColor(i, color);
-        }
 
-        // Increment the hue for the next frame
-        hue += speed;
-        if (hue >= 256) {
-            hue = 0; // Reset hue to loop the colors
-        }
+// Answer to <P0>/<P1>: one line per stage, all numbers in CPU cycles. Plain text without markers,
+// the ESP32 collects it up to the end line and serves it on /stats.
+//   P clock 600 frames 1500 effect thunder
+//   P effect <count> <min> <avg> <p99> <max>
+//   P end
+void reportStats(SerialHandler &handler, uint32_t reset) {
+    handler.msg().p("P clock ").p(F_CPU_ACTUAL / 1000000).p(" frames ").p(profiler.getCount(PROFILE_FRAME)).p(" effect ").p(effect->getName()).ln().send();
+    for (uint8_t stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+        handler.msg().p("P ").p(FrameProfiler::getStageName(stage)).p(' ').p(profiler.getCount(stage)).p(' ').p(profiler.getMin(stage)).p(' ')
+            .p(profiler.getAverage(stage)).p(' ').p(profiler.getPercentile(stage, 990)).p(' ').p(profiler.getMax(stage)).ln().send();
     }
+    handler.msg().p("P end").ln().send();
+    if (reset)
+        profiler.reset();
 }
 
-// I hate myself for this
-void updateBrightness() {
-    // Save the current rgb values in an array
+// Cost of the previous brightness pass, which read every pixel back from the drawing memory,
+// scaled it with floats and restored the unscaled copy after show(). Only used for the startup report.
+uint32_t measureLegacyBrightnessCycles() {
     static uint32_t currentRGB[LED_COUNT];
-    // Get the current brightness for the LEDs
+    float brightness = globalBrightness;
+    uint32_t start = ARM_DWT_CYCCNT;
     for (int i = 0; i < LED_COUNT; i++) {
         currentRGB[i] = leds.getPixel(i);
         uint32_t color = leds.getPixel(i);
         uint8_t r = (color >> 16) & 0xFF;
         uint8_t g = (color >> 8) & 0xFF;
         uint8_t b = color & 0xFF;
-        uint8_t newR = max(0, min(255, r * globalBrightness / 255));
-        uint8_t newG = max(0, min(255, g * globalBrightness / 255));
-        uint8_t newB = max(0, min(255, b * globalBrightness / 255));
+        uint8_t newR = max(0, min(255, r * brightness / 255));
+        uint8_t newG = max(0, min(255, g * brightness / 255));
+        uint8_t newB = max(0, min(255, b * brightness / 255));
         leds.setPixelColor(i, newR, newG, newB);
     }
-    leds.show();
-    // Set the old brightness values back after show(), so the brightness scaling is not applied repeatedly
     for (int i = 0; i < LED_COUNT; i++) {
         leds.setPixelColor(i, currentRGB[i]);
     }
-}
\ No newline at end of file
+    return ARM_DWT_CYCCNT - start;
+}
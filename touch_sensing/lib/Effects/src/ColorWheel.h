@@ -0,0 +1,77 @@
+/*"""
+
+ Color Wheel:
+ The 256 colors of FastLED's rainbow hue wheel (hsv2rgb_rainbow) as a table generated at compile time,
+ plus a per-LED hue offset table, so hue based effects render with one table load per pixel instead of a
+ divide and an HSV conversion.
+
+   HueGradient gradient;
+   gradient.begin(ledCount);           // once, or whenever the LED count changes
+   gradient.render(frame, hue);        // hue is 8.8 fixed point, the strip spans one full turn
+   gradient.begin(space);              // or the lamp spans one full turn along x, see LedSpace.h
+
+"""*/
+#ifndef ColorWheel_H
+#define ColorWheel_H
+#include "Arduino.h"
+#include "Effect.h"
+#include "FastLED.h"
+#include "LedSpace.h"
+#include <inttypes.h>
+#include <utility>
+
+// FastLED's hsv2rgb_rainbow at full saturation and value (scale8 with FASTLED_SCALE8_FIXED), which is not
+// constexpr itself. The bench checks every hue against it.
+constexpr CRGB rainbowColor(uint8_t hue) {
+    uint8_t offset8 = (hue & 0x1F) << 3;
+    uint8_t third = (offset8 * (1 + 256 / 3)) >> 8;
+    uint8_t twothirds = (offset8 * (1 + 256 * 2 / 3)) >> 8;
+    switch (hue >> 5) {
+    case 0: // red to orange
+        return CRGB(255 - third, third, 0);
+    case 1: // orange to yellow
+        return CRGB(171, 85 + third, 0);
+    case 2: // yellow to green
+        return CRGB(171 - twothirds, 170 + third, 0);
+    case 3: // green to aqua
+        return CRGB(0, 255 - third, third);
+    case 4: // aqua to blue
+        return CRGB(0, 171 - twothirds, 85 + twothirds);
+    case 5: // blue to purple
+        return CRGB(third, 0, 255 - third);
+    case 6: // purple to pink
+        return CRGB(85 + third, 0, 171 - third);
+    default: // pink to red
+        return CRGB(170 + third, 0, 85 - third);
+    }
+}
+
+struct RainbowTable {
+    CRGB colors[256];
+};
+
+template <size_t... Hues>
+constexpr RainbowTable makeRainbowTable(std::index_sequence<Hues...>) {
+    return {{rainbowColor(Hues)...}};
+}
+
+// The 256 hues of the rainbow, 768 bytes of flash, one copy for the whole program
+inline constexpr RainbowTable rainbowTable = makeRainbowTable(std::make_index_sequence<256>());
+
+inline const CRGB *rainbowWheel() { return rainbowTable.colors; }
+
+class HueGradient {
+public:
+    void begin(uint16_t ledCount);
+    void begin(const LedSpace &space);
+    void render(CRGB *frame, uint16_t hue) const;
+    uint16_t getLedCount() const { return _ledCount; }
+    // Hue offset of one LED, 0..255 over the strip
+    uint8_t getOffset(uint16_t led) const { return _offsets[led]; }
+
+private:
+    uint16_t _ledCount = 0;
+    uint8_t _offsets[EFFECTS_MAX_LEDS];
+};
+
+#endif
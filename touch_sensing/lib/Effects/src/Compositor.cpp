@@ -0,0 +1,123 @@
+#include "Compositor.h"
+#include "Arduino.h"
+#include <string.h>
+
+void Layer::begin(CRGB *pixels, BlendMode mode, uint8_t *alpha) {
+    _pixels = pixels;
+    _alpha = alpha;
+    _mode = mode;
+    _enabled = true;
+    markDirty();
+}
+
+// The effect begins on the layer's own buffer, the previous one ends
+void Layer::setEffect(Effect *effect) {
+    if (effect == _effect)
+        return;
+    if (_effect)
+        _effect->end();
+    _effect = effect;
+    if (_effect) {
+        LedBuffer buffer = {_pixels, _count};
+        _effect->begin(buffer);
+        _effect->markDirty();
+    }
+    markDirty();
+}
+
+// Switching a layer on or off changes every LED it covers
+void Layer::setEnabled(bool enabled) {
+    if (enabled == _enabled)
+        return;
+    _enabled = enabled;
+    markDirty();
+}
+
+void Layer::setMode(BlendMode mode) {
+    if (mode == _mode)
+        return;
+    _mode = mode;
+    markDirty();
+}
+
+void Layer::setOpacity(uint8_t opacity) {
+    if (opacity == _opacity)
+        return;
+    _opacity = opacity;
+    markDirty();
+}
+
+void Layer::_blend(CRGB *out, uint16_t first, uint16_t end) const {
+    const CRGB *pixels = _pixels;
+    switch (_mode) {
+    case BLEND_REPLACE:
+        memcpy(out + first, pixels + first, (end - first) * sizeof(CRGB));
+        break;
+    case BLEND_ADD:
+        for (uint16_t i = first; i < end; i++) {
+            CRGB color = pixels[i];
+            out[i] += _opacity == 255 ? color : color.nscale8(_opacity);
+        }
+        break;
+    case BLEND_ALPHA:
+        for (uint16_t i = first; i < end; i++) {
+            uint8_t alpha = _alpha ? scale8(_alpha[i], _opacity) : _opacity;
+            out[i] = blend(out[i], pixels[i], alpha);
+        }
+        break;
+    case BLEND_MAX:
+        for (uint16_t i = first; i < end; i++) {
+            CRGB color = pixels[i];
+            if (_opacity != 255)
+                color.nscale8(_opacity);
+            out[i] = CRGB(max(out[i].r, color.r), max(out[i].g, color.g), max(out[i].b, color.b));
+        }
+        break;
+    }
+}
+
+void Compositor::begin(LedBuffer &buffer) {
+    _buffer = buffer;
+    for (uint8_t n = 0; n < maxLayers; n++)
+        _layers[n]._count = buffer.count;
+    markDirty();
+}
+
+void Compositor::markDirty() {
+    for (uint8_t n = 0; n < maxLayers; n++)
+        _layers[n].markDirty();
+}
+
+bool Compositor::render(const FrameTime &time) {
+    // Effects render into their own layers, static ones only when they have to
+    DirtyRange dirty;
+    for (uint8_t n = 0; n < maxLayers; n++) {
+        Layer &layer = _layers[n];
+        Effect *effect = layer._effect;
+        if (layer._enabled && layer._pixels && effect && (!effect->isStatic() || effect->isDirty())) {
+            LedBuffer buffer = {layer._pixels, layer._count};
+            effect->render(time, buffer);
+            effect->clearDirty();
+            uint16_t first, end;
+            effect->getChanged(layer._count, first, end);
+            layer.markDirty(first, end);
+        }
+        // Disabled layers still count once, for the LEDs they stop covering
+        dirty.add(layer._dirty.first, layer._dirty.end);
+        layer._dirty.clear();
+    }
+    _blended = dirty.isEmpty() ? 0 : dirty.end - dirty.first;
+    _totalBlended += _blended;
+    if (dirty.isEmpty())
+        return false;
+
+    // Black under the bottom layer, then every enabled layer over the range
+    CRGB *out = _buffer.pixels;
+    memset(out + dirty.first, 0, (dirty.end - dirty.first) * sizeof(CRGB));
+    for (uint8_t n = 0; n < maxLayers; n++) {
+        const Layer &layer = _layers[n];
+        if (layer._enabled && layer._pixels)
+            layer._blend(out, dirty.first, dirty.end);
+    }
+    return true;
+}
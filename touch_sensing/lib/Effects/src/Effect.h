@@ -0,0 +1,60 @@
+/*"""
+
+ Effect:
+ Interface of one lamp effect. Effects are preallocated once (see Effects.h) and keep all their state in
+ their own members, so switching away from an effect and back does not lose or reset anything else.
+
+   begin()  the effect becomes the current one, the buffer holds whatever was shown before
+   render() draw one frame at time.micros, time.delta after the previous one (see FrameClock.h).
+            Animations advance by the delta, not per call, so the frame rate does not change their speed.
+   end()    another effect takes over
+
+ An effect also tells the render loop how often it wants to be rendered, and whether its output only
+ changes when its settings change. Static effects are rendered once and then skipped until markDirty().
+ getChanged() narrows down which LEDs the last render() touched, for callers that only pass those on
+ (see Compositor.h). By default that is the whole buffer.
+
+"""*/
+#ifndef Effect_H
+#define Effect_H
+#include "FastLED.h"
+#include "FrameClock.h"
+#include <inttypes.h>
+
+// Size of the per-LED scratch tables, longer strips are only rendered up to here. Set by the build to the
+// lamp's LED count (build_flags in platformio.ini), so no effect reserves memory for LEDs that do not exist.
+#ifndef EFFECTS_MAX_LEDS
+#error "EFFECTS_MAX_LEDS has to be set by the build, e.g. -D EFFECTS_MAX_LEDS=247"
+#endif
+
+// Logical framebuffer, one CRGB per LED
+struct LedBuffer {
+    CRGB *pixels;
+    uint16_t count;
+};
+
+class Effect {
+public:
+    virtual const char *getName() const = 0;
+    virtual void begin(LedBuffer &buffer) {}
+    virtual void render(const FrameTime &time, LedBuffer &buffer) = 0;
+    virtual void end() {}
+
+    // Preferred time between two frames in microseconds
+    virtual uint32_t getFrameInterval() const { return 20000; }
+    virtual bool isStatic() const { return false; }
+    // LEDs [first, end) the last render() changed, first == end if none
+    virtual void getChanged(uint16_t count, uint16_t &first, uint16_t &end) const {
+        first = 0;
+        end = count;
+    }
+    // Set whenever a static effect needs to be drawn again, cleared by the render loop
+    bool isDirty() const { return _dirty; }
+    void markDirty() { _dirty = true; }
+    void clearDirty() { _dirty = false; }
+
+protected:
+    bool _dirty = true;
+};
+
+#endif
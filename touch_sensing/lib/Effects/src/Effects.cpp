@@ -0,0 +1,373 @@
+#include "Effects.h"
+
+// Shared by all effects. Reseed it for reproducible frames.
+FastRandom effectRandom;
+
+void seedEffects(uint32_t seed) { effectRandom.seed(seed); }
+
+ThunderEffect thunderEffect;
+SunlightEffect sunlightEffect;
+RainbowEffect rainbowEffect;
+ColorEffect colorEffect;
+CloudEffect cloudEffect;
+
+// Indexed by the lamp mode
+static Effect *const effectRegistry[] = {
+    &thunderEffect,
+    &sunlightEffect,
+    &rainbowEffect,
+    &colorEffect,
+    &cloudEffect,
+};
+
+Effect *getEffect(uint8_t mode) { return mode < getEffectCount() ? effectRegistry[mode] : nullptr; }
+uint8_t getEffectCount() { return sizeof(effectRegistry) / sizeof(effectRegistry[0]); }
+
+// Base values for thunder effect parameters, times in ms
+const uint8_t BACKGROUND_BLUE = 50;
+const unsigned long LIGHTNING_DURATION = 50;
+const unsigned long LAST_FLASH_DURATION = 200;
+const unsigned long FLASH_INTERVAL = 100;
+const unsigned long LIGHTNING_COOLDOWN = 10000; // average time between storms
+const unsigned long FOLLOW_UP_WINDOW = 1500;     // more bolts of the same storm start within this time
+const int MIN_FLASHES = 1;
+const int MAX_FLASHES = 6;
+const unsigned long FAST_DECAY = 40;   // time constant while brighter than AFTERGLOW_LEVEL
+const unsigned long SLOW_DECAY = 300;  // time constant of the afterglow
+const uint16_t AFTERGLOW_LEVEL = 64 << 8;
+const uint16_t MIN_GLOW = 2 << 8;      // below this a LED is back to the background
+const unsigned long SHIMMER_PERIOD = 100; // every background LED gets a new random blue about this often
+
+void ThunderEffect::setBackground(bool shown) {
+    if (shown == _backgroundShown)
+        return;
+    _backgroundShown = shown;
+    // Laid out again by the next begin()
+    _ledCount = 0;
+}
+
+void ThunderEffect::begin(LedBuffer &buffer) {
+    if (_ledCount != buffer.count) {
+        _ledCount = min(buffer.count, (uint16_t)EFFECTS_MAX_LEDS);
+        for (uint16_t i = 0; i < _ledCount; i++) {
+            _background[i] = _backgroundShown ? BACKGROUND_BLUE : 0;
+            _glow[i] = 0;
+        }
+        _litCount = 0;
+        for (uint8_t b = 0; b < maxBolts; b++)
+            _bolts[b].litLeds = 0;
+    }
+    // The buffer holds the previous effect, repaint everything once
+    for (uint16_t i = 0; i < _ledCount; i++)
+        buffer.pixels[i] = CRGB(0, 0, _background[i]);
+    _changedFirst = 0;
+    _changedEnd = _ledCount;
+    _started = false;
+}
+
+void ThunderEffect::getChanged(uint16_t count, uint16_t &first, uint16_t &end) const {
+    first = min(_changedFirst, count);
+    end = min(_changedEnd, count);
+}
+
+void ThunderEffect::render(const FrameTime &time, LedBuffer &buffer) {
+    uint32_t frameTime = time.millis;
+    // Nothing changed yet, widened by every LED written below
+    _changedFirst = EFFECTS_MAX_LEDS;
+    _changedEnd = 0;
+    if (_ledCount != min(buffer.count, (uint16_t)EFFECTS_MAX_LEDS))
+        begin(buffer);
+    if (!_started) {
+        _nextSpawnTime = frameTime + effectRandom.below(LIGHTNING_COOLDOWN);
+        _started = true;
+    }
+
+    _decay(time.delta, buffer);
+
+    // Storms come at random, the first bolt may bring a couple of others shortly after it
+    if ((int32_t)(frameTime - _nextSpawnTime) >= 0) {
+        _spawn(frameTime, _ledCount);
+        if (effectRandom.chance(128))
+            _nextSpawnTime = frameTime + effectRandom.range(200, FOLLOW_UP_WINDOW);
+        else
+            _nextSpawnTime = frameTime + LIGHTNING_COOLDOWN / 2 + effectRandom.below(LIGHTNING_COOLDOWN);
+    }
+    for (uint8_t b = 0; b < maxBolts; b++) {
+        if (_bolts[b].flashesLeft)
+            _updateBolt(b, frameTime);
+    }
+
+    _shimmer(time.delta, buffer);
+
+    // Mix the lightning over the background of every lit LED
+    for (uint16_t n = 0; n < _litCount; n++) {
+        uint16_t i = _lit[n];
+        buffer.pixels[i] = blend(CRGB(0, 0, _background[i]), _bolts[_source[i]].color, _glow[i] >> 8);
+        _changed(i);
+    }
+    if (_changedFirst > _changedEnd)
+        _changedFirst = _changedEnd = 0;
+}
+
+// One bolt from the pool, nothing happens if all of them are busy or still glowing
+void ThunderEffect::_spawn(uint32_t now, uint16_t ledCount) {
+    Bolt *bolt = nullptr;
+    for (uint8_t b = 0; b < maxBolts; b++) {
+        if (!_bolts[b].flashesLeft && !_bolts[b].litLeds) {
+            bolt = &_bolts[b];
+            break;
+        }
+    }
+    if (!bolt)
+        return;
+
+    if (_space) {
+        _spawnInSpace(*bolt);
+    } else {
+        Segment &trunk = bolt->segments[0];
+        trunk.start = effectRandom.below(ledCount);
+        trunk.length = effectRandom.range(1, ledCount / 8 + 1); // At most an eighth of the strip
+        trunk.level = 255 << 8;
+        bolt->segmentCount = 1;
+        // Branches: shorter and dimmer, forking off somewhere along the trunk
+        uint8_t branches = effectRandom.below(maxSegments);
+        for (uint8_t k = 0; k < branches; k++) {
+            Segment &branch = bolt->segments[bolt->segmentCount++];
+            branch.start = (trunk.start + effectRandom.below(trunk.length + 1)) % ledCount;
+            branch.length = effectRandom.range(1, trunk.length / 2 + 2);
+            branch.level = effectRandom.range(96, 192) << 8;
+        }
+    }
+    bolt->flashesLeft = effectRandom.range(MIN_FLASHES, MAX_FLASHES + 1);
+    bolt->on = false;
+    bolt->nextTime = now;
+
+    // Slightly vary from white
+    bolt->color = CRGB(235 + effectRandom.range(-20, 21), 235 + effectRandom.range(-20, 21), 235 + effectRandom.range(-20, 21));
+}
+
+// A bolt as spheres: the trunk around a random LED, branches around points close to it
+void ThunderEffect::_spawnInSpace(Bolt &bolt) {
+    Segment &trunk = bolt.segments[0];
+    trunk.center = _space->getPoint(effectRandom.below(min(_ledCount, _space->getCount())));
+    trunk.radius = effectRandom.range(24, 64);
+    trunk.level = 255 << 8;
+    bolt.segmentCount = 1;
+    uint8_t branches = effectRandom.below(maxSegments);
+    for (uint8_t k = 0; k < branches; k++) {
+        Segment &branch = bolt.segments[bolt.segmentCount++];
+        int16_t reach = trunk.radius;
+        branch.center.x = constrain(trunk.center.x + effectRandom.range(-reach, reach + 1), 0, 255);
+        branch.center.y = constrain(trunk.center.y + effectRandom.range(-reach, reach + 1), 0, 255);
+        branch.center.z = constrain(trunk.center.z + effectRandom.range(-reach, reach + 1), 0, 255);
+        branch.radius = effectRandom.range(12, trunk.radius / 2 + 13);
+        branch.level = effectRandom.range(96, 192) << 8;
+    }
+}
+
+// Step the flash sequence to the current time, then keep the segments lit while the flash is on
+void ThunderEffect::_updateBolt(uint8_t index, uint32_t now) {
+    Bolt &bolt = _bolts[index];
+    while (bolt.flashesLeft && (int32_t)(now - bolt.nextTime) >= 0) {
+        if (bolt.on) {
+            bolt.on = false;
+            bolt.flashesLeft--;
+            bolt.nextTime += FLASH_INTERVAL + effectRandom.range(-20, 21);
+        } else {
+            bolt.on = true;
+            bolt.nextTime += bolt.flashesLeft == 1 ? LAST_FLASH_DURATION + effectRandom.range(-50, 51) : LIGHTNING_DURATION + effectRandom.range(-10, 11);
+        }
+    }
+    if (!bolt.on)
+        return;
+    for (uint8_t k = 0; k < bolt.segmentCount; k++) {
+        const Segment &segment = bolt.segments[k];
+        if (_space) {
+            // Full level in the middle, falling off to nothing at the radius
+            uint32_t radiusSquared = segment.radius * segment.radius + 1;
+            _space->forEachWithin(segment.center, segment.radius, [&](uint16_t led, uint16_t distanceSquared) {
+                uint16_t level = (uint32_t)segment.level * (radiusSquared - distanceSquared) / radiusSquared;
+                if (led < _ledCount && level >= MIN_GLOW)
+                    _light(led, level, index);
+            });
+            continue;
+        }
+        uint16_t led = segment.start;
+        for (uint16_t n = 0; n < segment.length; n++) {
+            _light(led, segment.level, index);
+            if (++led == _ledCount)
+                led = 0;
+        }
+    }
+}
+
+// The brightest bolt on a LED gives it its color
+void ThunderEffect::_light(uint16_t led, uint16_t level, uint8_t bolt) {
+    if (level <= _glow[led])
+        return;
+    if (_glow[led] == 0)
+        _lit[_litCount++] = led;
+    else
+        _bolts[_source[led]].litLeds--;
+    _glow[led] = level;
+    _source[led] = bolt;
+    _bolts[bolt].litLeds++;
+}
+
+// Exponential decay over the elapsed microseconds, factors in 0.16 fixed point.
+// LEDs that went dark get their background back.
+void ThunderEffect::_decay(uint32_t elapsed, LedBuffer &buffer) {
+    uint32_t fast = expf(-(float)elapsed / (FAST_DECAY * 1000)) * 65536.0f;
+    uint32_t slow = expf(-(float)elapsed / (SLOW_DECAY * 1000)) * 65536.0f;
+    uint16_t n = 0;
+    while (n < _litCount) {
+        uint16_t i = _lit[n];
+        uint32_t glow = _glow[i];
+        glow = (glow * (glow > AFTERGLOW_LEVEL ? fast : slow) + 0x8000) >> 16; // rounded, or high frame rates would decay faster
+        if (glow < MIN_GLOW) {
+            _glow[i] = 0;
+            _bolts[_source[i]].litLeds--;
+            buffer.pixels[i] = CRGB(0, 0, _background[i]);
+            _changed(i);
+            _lit[n] = _lit[--_litCount];
+            continue;
+        }
+        _glow[i] = glow;
+        n++;
+    }
+}
+
+// Give a few background LEDs a new random blue, as many as are due for the elapsed microseconds
+void ThunderEffect::_shimmer(uint32_t elapsed, LedBuffer &buffer) {
+    if (!_backgroundShown)
+        return;
+    _shimmerCarry += (uint32_t)_ledCount * elapsed;
+    uint32_t count = _shimmerCarry / (SHIMMER_PERIOD * 1000);
+    _shimmerCarry -= count * SHIMMER_PERIOD * 1000;
+    while (count--) {
+        uint16_t i = effectRandom.below(_ledCount);
+        _background[i] = BACKGROUND_BLUE + effectRandom.range(-15, 16);
+        // Lit LEDs are mixed with their new background afterwards
+        if (_glow[i] == 0) {
+            buffer.pixels[i] = CRGB(0, 0, _background[i]);
+            _changed(i);
+        }
+    }
+}
+
+uint8_t ThunderEffect::getActiveBolts() const {
+    uint8_t count = 0;
+    for (uint8_t b = 0; b < maxBolts; b++) {
+        if (_bolts[b].flashesLeft)
+            count++;
+    }
+    return count;
+}
+
+void SunlightEffect::render(const FrameTime &time, LedBuffer &buffer) {
+    // Same flicker until the next one is due, the frame keeps the last one
+    _flickered = false;
+    if (_started && (int32_t)(time.millis - _nextFlickerTime) < 0)
+        return;
+    _flickered = true;
+    _nextFlickerTime += flickerPeriod;
+    // First frame, or fell behind by more than a period: start counting from now
+    if (!_started || (int32_t)(time.millis - _nextFlickerTime) >= 0)
+        _nextFlickerTime = time.millis + flickerPeriod;
+    _started = true;
+
+    // Set the brightness of each LED to a warmer orange color with flickering effect
+    uint16_t ledCount = min(buffer.count, (uint16_t)EFFECTS_MAX_LEDS);
+    effectRandom.fillRange(_flickers, ledCount, -10, 11);
+
+    // Saturating add or subtract on all three channels of the warm base color
+    for (int i = 0; i < ledCount; i++) {
+        int8_t flicker = _flickers[i];
+        CRGB color = _color;
+        buffer.pixels[i] = flicker >= 0 ? color.addToRGB(flicker) : color.subtractFromRGB(-flicker);
+    }
+}
+
+void ColorEffect::setColor(uint32_t color) {
+    if (CRGB(color) == _color)
+        return;
+    _color = color;
+    markDirty();
+}
+
+void ColorEffect::render(const FrameTime &time, LedBuffer &buffer) {
+    fill_solid(buffer.pixels, buffer.count, _color);
+}
+
+// Function to convert a hue value to a color, the rainbow before it moved to FastLED's hue wheel.
+// Only kept as the baseline of the benchmarks.
+uint32_t Wheel(byte WheelPos) {
+    WheelPos = 255 - WheelPos; // Reverse the wheel for a different effect
+    if (WheelPos < 85) {
+        return packColor(255 - WheelPos * 3, 0, WheelPos * 3); // Red to Green
+    } else if (WheelPos < 170) {
+        WheelPos -= 85;
+        return packColor(0, WheelPos * 3, 255 - WheelPos * 3); // Green to Blue
+    } else {
+        WheelPos -= 170;
+        return packColor(WheelPos * 3, 255 - WheelPos * 3, 0); // Blue to Red
+    }
+}
+
+void RainbowEffect::setSpace(const LedSpace *space) {
+    _space = space;
+    // Laid out again on the next frame
+    _gradient.begin(0);
+}
+
+void RainbowEffect::render(const FrameTime &time, LedBuffer &buffer) {
+    // Advance the hue by the elapsed time, the remainder carries over so the speed is exact at any frame rate.
+    // Wraps around with the 16 bit counter.
+    uint64_t step = (uint64_t)_speed * time.delta + _hueRemainder;
+    _hue += step / 1000000;
+    _hueRemainder = step % 1000000;
+
+    if (_gradient.getLedCount() != buffer.count) {
+        if (_space && _space->getCount() == buffer.count)
+            _gradient.begin(*_space);
+        else
+            _gradient.begin(buffer.count);
+    }
+    _gradient.render(buffer.pixels, _hue);
+}
+
+// 8.8 noise units per unit of position: about three cells across the lamp, or one per ten LEDs along the strip
+const uint16_t CLOUD_SPACE_SCALE = 3;
+const uint16_t CLOUD_STRIP_SCALE = 256 / 10;
+// Clear sky below, full cloud above, a soft edge in between
+const uint8_t CLOUD_EDGE_LOW = 100;
+const uint8_t CLOUD_EDGE_HIGH = 170;
+
+void CloudEffect::setColors(uint32_t sky, uint32_t cloud) {
+    for (uint16_t n = 0; n < 256; n++) {
+        uint16_t t = n <= CLOUD_EDGE_LOW ? 0 : n >= CLOUD_EDGE_HIGH ? 255 : (n - CLOUD_EDGE_LOW) * 255 / (CLOUD_EDGE_HIGH - CLOUD_EDGE_LOW);
+        _palette[n] = blend(CRGB(sky), CRGB(cloud), min(noiseTables.fade[t], (uint16_t)255));
+    }
+}
+
+void CloudEffect::render(const FrameTime &time, LedBuffer &buffer) {
+    // Same carry as the rainbow hue, exact at any frame rate and wrapping with the noise
+    uint64_t step = (uint64_t)_driftSpeed * time.delta + _driftRemainder;
+    _drift += step / 1000000;
+    _driftRemainder = step % 1000000;
+    step = (uint64_t)_churnSpeed * time.delta + _churnRemainder;
+    _churn += step / 1000000;
+    _churnRemainder = step % 1000000;
+
+    if (_space && _space->getCount() == buffer.count) {
+        for (uint16_t i = 0; i < buffer.count; i++) {
+            const LedPoint &p = _space->getPoint(i);
+            uint16_t x = p.x * CLOUD_SPACE_SCALE + _drift;
+            uint16_t y = p.y * CLOUD_SPACE_SCALE;
+            buffer.pixels[i] = _palette[fractalNoise3(x, y, _churn)];
+        }
+    } else {
+        for (uint16_t i = 0; i < buffer.count; i++)
+            buffer.pixels[i] = _palette[fractalNoise3(i * CLOUD_STRIP_SCALE + _drift, 0x8000, _churn)];
+    }
+}
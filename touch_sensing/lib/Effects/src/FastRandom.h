@@ -0,0 +1,53 @@
+/*"""
+
+ Fast Random:
+ Seedable xorshift32 generator for the effects, replacing Arduino random() in per-LED loops.
+ Ranges are reduced with a multiply and shift instead of a modulo. The bulk fill takes 4 values
+ out of every 32 bit step for ranges up to 256 values wide, probabilities have 1/256 resolution.
+
+ Same seed, same sequence: seed it with a constant for reproducible frames.
+
+"""*/
+#ifndef FastRandom_H
+#define FastRandom_H
+#include <inttypes.h>
+
+class FastRandom {
+public:
+    explicit FastRandom(uint32_t seed = 2463534242UL) { this->seed(seed); }
+
+    // Zero is the one state xorshift never leaves
+    inline void seed(uint32_t seed) { _state = seed ? seed : 2463534242UL; }
+
+    inline uint32_t next() {
+        uint32_t x = _state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        _state = x;
+        return x;
+    }
+
+    // [0, bound)
+    inline uint32_t below(uint32_t bound) { return ((uint64_t)next() * bound) >> 32; }
+    // [low, high), same range as Arduino's random(low, high)
+    inline int32_t range(int32_t low, int32_t high) { return low + (int32_t)below(high - low); }
+    // True with a probability of probability / 256
+    inline bool chance(uint8_t probability) { return (next() & 0xFF) < probability; }
+
+    // count values in [low, high), high - low at most 256
+    void fillRange(int8_t *dest, uint16_t count, int16_t low, int16_t high) {
+        uint16_t span = high - low;
+        uint16_t i = 0;
+        while (i < count) {
+            uint32_t bits = next();
+            for (uint8_t k = 0; k < 4 && i < count; k++, i++, bits >>= 8)
+                dest[i] = low + (int16_t)(((bits & 0xFF) * span) >> 8);
+        }
+    }
+
+private:
+    uint32_t _state;
+};
+
+#endif
@@ -0,0 +1,65 @@
+/*"""
+
+ Frame Clock:
+ Samples the time once per frame, so every effect of the frame sees the same timestamp and the
+ time since the previous frame. Effects advance by that delta instead of by frame count, so they
+ run at the same speed at 60, 120 or 400 frames per second.
+
+ tick() reads micros(); tick(now) takes the time from anywhere else, e.g. a virtual clock that
+ renders hours of animation faster than real time on the host.
+
+ The frame time is animation time: it moves by delta, which is clamped to maxDelta. After a stall
+ micros and millis fall behind the hardware clock, so effects that look at the time and effects that
+ add up delta stay in step.
+
+"""*/
+#ifndef FrameClock_H
+#define FrameClock_H
+#include "Arduino.h"
+#include <inttypes.h>
+
+struct FrameTime {
+    uint32_t micros; // animation time of the frame, starts at the first sample
+    uint32_t millis; // the same in milliseconds, counted on so it does not jump when micros wraps
+    uint32_t delta;  // microseconds since the previous frame
+    uint32_t frame;  // frames since start
+};
+
+class FrameClock {
+public:
+    // Sample the clock, once per frame
+    const FrameTime &tick() { return tick(::micros()); }
+
+    const FrameTime &tick(uint32_t now) {
+        if (_time.frame == 0) {
+            _time.millis = now / 1000;
+            _microsCarry = now % 1000;
+            _time.micros = now;
+            _now = now;
+        }
+        uint32_t delta = now - _now;
+        _now = now;
+        // Frames after a long stall only move the animation by maxDelta, so nothing jumps ahead
+        if (delta > _maxDelta)
+            delta = _maxDelta;
+        _microsCarry += delta;
+        _time.millis += _microsCarry / 1000;
+        _microsCarry %= 1000;
+        _time.delta = delta;
+        _time.micros += delta;
+        _time.frame++;
+        return _time;
+    }
+
+    const FrameTime &get() const { return _time; }
+    void setMaxDelta(uint32_t maxDelta) { _maxDelta = maxDelta; }
+
+private:
+    FrameTime _time = {0, 0, 0, 0};
+    uint32_t _maxDelta = 100000;
+    // Last sample of the hardware clock
+    uint32_t _now = 0;
+    uint32_t _microsCarry = 0;
+};
+
+#endif
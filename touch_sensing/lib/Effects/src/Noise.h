@@ -0,0 +1,101 @@
+/*"""
+
+ Noise:
+ Fixed-point 3-D value noise, for effects that want slow organic movement instead of per-LED random
+ jitter. Coordinates are 8.8 fixed point: the high byte picks a lattice cell, the low byte is the position
+ inside it. Every lattice point gets a pseudo-random value from a permutation table generated at compile
+ time, and the 8 corners of a cell are blended with a smoothstep along each axis. Results are 0..255,
+ continuous across cells, and repeat every 256 cells, so 16 bit coordinates can simply wrap around.
+
+   uint8_t v = noise3(x, y, z);           // one octave
+   uint8_t v = fractalNoise3(x, y, z);    // plus a second octave at twice the frequency
+
+ Integer arithmetic only. On cores with the DSP extension (Cortex-M4/M7) every lerp is a single SMUAD,
+ a dual 16 x 16 multiply-add of both corners with both weights; elsewhere the same sum is computed in
+ plain C. Both give bit-identical results. Build with -D NOISE_PORTABLE to force the plain version.
+
+"""*/
+#ifndef Noise_H
+#define Noise_H
+#include <inttypes.h>
+
+#if defined(__ARM_FEATURE_DSP) && !defined(NOISE_PORTABLE)
+#define NOISE_DSP 1
+#else
+#define NOISE_DSP 0
+#endif
+
+struct NoiseTables {
+    uint8_t permutation[512]; // a shuffle of 0..255, twice so corner lookups need no wrap
+    uint16_t fade[256];       // smoothstep 3t^2 - 2t^3, 0..256
+
+    constexpr NoiseTables() : permutation(), fade() {
+        for (int i = 0; i < 256; i++)
+            permutation[i] = i;
+        // Fisher-Yates with a fixed xorshift, the same lattice on every build
+        uint32_t state = 2463534242UL;
+        for (int i = 255; i > 0; i--) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            int j = ((uint64_t)state * (i + 1)) >> 32;
+            uint8_t swap = permutation[i];
+            permutation[i] = permutation[j];
+            permutation[j] = swap;
+        }
+        for (int i = 0; i < 256; i++)
+            permutation[i + 256] = permutation[i];
+        for (uint32_t t = 0; t < 256; t++)
+            fade[t] = (t * t * (768 - 2 * t) + 32768) >> 16;
+    }
+};
+
+// Lives in flash, 1 KB, a single copy shared by every file that includes this
+inline constexpr NoiseTables noiseTables{};
+
+// Weight of the second value in the high halfword, of the first in the low one
+inline uint32_t noiseWeights(uint16_t fraction) { return ((uint32_t)fraction << 16) | (256 - fraction); }
+
+// a + (b - a) * fraction / 256, with the weights of noiseWeights(fraction)
+inline uint8_t noiseLerp(uint8_t a, uint8_t b, uint32_t weights) {
+#if NOISE_DSP
+    uint32_t sum;
+    asm("smuad %0, %1, %2" : "=r"(sum) : "r"(a | ((uint32_t)b << 16)), "r"(weights));
+    return sum >> 8;
+#else
+    return (a * (weights & 0xFFFF) + b * (weights >> 16)) >> 8;
+#endif
+}
+
+inline uint8_t noise3(uint16_t x, uint16_t y, uint16_t z) {
+    const uint8_t *p = noiseTables.permutation;
+    uint8_t xi = x >> 8;
+    uint8_t yi = y >> 8;
+    uint8_t zi = z >> 8;
+    uint32_t u = noiseWeights(noiseTables.fade[x & 0xFF]);
+    uint32_t v = noiseWeights(noiseTables.fade[y & 0xFF]);
+    uint32_t w = noiseWeights(noiseTables.fade[z & 0xFF]);
+
+    // Hash of the 8 corners, Perlin's nested permutation lookups
+    uint16_t a = p[xi] + yi;
+    uint16_t b = p[xi + 1] + yi;
+    uint16_t aa = p[a] + zi;
+    uint16_t ab = p[a + 1] + zi;
+    uint16_t ba = p[b] + zi;
+    uint16_t bb = p[b + 1] + zi;
+
+    uint8_t x00 = noiseLerp(p[aa], p[ba], u);
+    uint8_t x10 = noiseLerp(p[ab], p[bb], u);
+    uint8_t x01 = noiseLerp(p[aa + 1], p[ba + 1], u);
+    uint8_t x11 = noiseLerp(p[ab + 1], p[bb + 1], u);
+    return noiseLerp(noiseLerp(x00, x10, v), noiseLerp(x01, x11, v), w);
+}
+
+// Two octaves, the finer one at a third of the weight and shifted so the lattices do not line up
+inline uint8_t fractalNoise3(uint16_t x, uint16_t y, uint16_t z) {
+    uint16_t coarse = noise3(x, y, z);
+    uint16_t fine = noise3((x << 1) + 0x5A00, (y << 1) + 0x3C00, (z << 1) + 0x7100);
+    return ((coarse * 2 + fine) * 85) >> 8;
+}
+
+#endif
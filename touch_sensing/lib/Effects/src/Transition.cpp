@@ -0,0 +1,121 @@
+#include "Transition.h"
+#include "Arduino.h"
+#include <string.h>
+
+void Transition::begin(CRGB *fromPixels, CRGB *toPixels) {
+    _fromPixels = fromPixels;
+    _toPixels = toPixels;
+}
+
+void Transition::setEasing(Easing easing) { _easing = easing; }
+
+void Transition::start(Effect *from, Effect *to, uint8_t fromBrightness, uint8_t toBrightness, uint32_t duration,
+                       LedBuffer &buffer) {
+    size_t bytes = buffer.count * sizeof(CRGB);
+    // Outgoing effect of an interrupted transition, still rendering into the from buffer
+    Effect *running = _active ? _from : nullptr;
+
+    // The incoming effect draws on top of its own last frame if it has one
+    if (_active && to == running)
+        memcpy(_toPixels, _fromPixels, bytes);
+    else if (!(_active && to == _to))
+        memcpy(_toPixels, buffer.pixels, bytes);
+
+    if (_active || from == to) {
+        // Fade out of exactly what is shown now
+        memcpy(_fromPixels, buffer.pixels, bytes);
+        if (running && running != to)
+            running->end();
+        if (from != to)
+            from->end();
+        _from = nullptr;
+    } else {
+        // The outgoing effect keeps drawing on what it showed, it may only repaint the LEDs that changed
+        memcpy(_fromPixels, buffer.pixels, bytes);
+        _from = from;
+    }
+    if (to != from && to != running) {
+        LedBuffer toBuffer = {_toPixels, buffer.count};
+        to->begin(toBuffer);
+    }
+
+    _to = to;
+    _fromBrightness = fromBrightness;
+    _toBrightness = toBrightness;
+    _brightness = fromBrightness;
+    _progress = 0;
+    _started = false;
+    _duration = max(duration, (uint32_t)1);
+    _active = true;
+}
+
+void Transition::cancel(LedBuffer &buffer) {
+    if (_active)
+        memcpy(buffer.pixels, _toPixels, buffer.count * sizeof(CRGB));
+    _stop();
+}
+
+void Transition::_stop() {
+    if (_active && _from)
+        _from->end();
+    _from = nullptr;
+    _active = false;
+}
+
+bool Transition::render(const FrameTime &time, LedBuffer &buffer) {
+    if (!_active)
+        return false;
+    if (!_started) {
+        _startTime = time.millis;
+        _started = true;
+    }
+    uint32_t elapsed = time.millis - _startTime;
+    bool done = elapsed >= _duration;
+    uint16_t t = done ? 65535 : (uint64_t)elapsed * 65535 / _duration;
+    _progress = ease(_easing, t);
+    _brightness = ((uint32_t)_fromBrightness * (65535 - _progress) + (uint32_t)_toBrightness * _progress + 32767) / 65535;
+
+    LedBuffer fromBuffer = {_fromPixels, buffer.count};
+    LedBuffer toBuffer = {_toPixels, buffer.count};
+    if (_from)
+        _from->render(time, fromBuffer);
+    _to->render(time, toBuffer);
+
+    // At 255 FastLED's blend8 gives exactly the incoming side
+    blend(_fromPixels, _toPixels, buffer.pixels, buffer.count, _progress >> 8);
+
+    // The last frame is the incoming side already
+    if (done)
+        _stop();
+    return _active;
+}
+
+bool Transition::isActive() const { return _active; }
+
+// Fast enough for both sides
+uint32_t Transition::getFrameInterval() const {
+    uint32_t interval = _to ? _to->getFrameInterval() : 20000;
+    if (_from)
+        interval = min(interval, _from->getFrameInterval());
+    return interval;
+}
+
+uint8_t Transition::getBrightness() const { return _brightness; }
+uint16_t Transition::getProgress() const { return _progress; }
+
+// All curves run from 0 to 65535 and end exactly there
+uint16_t Transition::ease(Easing easing, uint16_t t) {
+    switch (easing) {
+    case EASE_IN:
+        return (uint32_t)t * t / 65535;
+    case EASE_OUT:
+        return 65535 - ease(EASE_IN, 65535 - t);
+    case EASE_IN_OUT: {
+        // t * t * (3 - 2 * t)
+        uint64_t square = (uint64_t)t * t;
+        return square * (3 * 65535 - 2 * (uint64_t)t) / ((uint64_t)65535 * 65535);
+    }
+    default:
+        return t;
+    }
+}
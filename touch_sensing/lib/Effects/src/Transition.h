@@ -0,0 +1,75 @@
+/*"""
+
+ Transition:
+ Blends from what the strip shows now into a new effect and brightness over a given time, instead of
+ switching at once. The outgoing and the incoming effect each render into their own buffer and the
+ result is mixed into the framebuffer with an eased progress (FastLED's blend()). Brightness follows the
+ same curve, the caller hands getBrightness() to the output stage on every frame.
+
+ The outgoing side keeps animating when the effect changes. It is a snapshot of the last frame when the
+ effect stays the same (e.g. a new color), and when a transition is interrupted by the next one, so a
+ fade always starts from exactly what was on the strip.
+
+   transition.begin(fromPixels, toPixels);            // two buffers of the framebuffer size
+   transition.start(effect, next, brightness, target, 2000, buffer);
+   if (transition.isActive())
+       transition.render(frameClock.tick(), buffer);  // instead of effect->render()
+
+ The transition calls begin()/end() of the effects it takes over: begin() of the incoming one on start,
+ end() of the outgoing one when it is done.
+
+"""*/
+#ifndef Transition_H
+#define Transition_H
+#include "Effect.h"
+#include <inttypes.h>
+
+class Transition {
+public:
+    enum Easing : uint8_t {
+        EASE_LINEAR,
+        EASE_IN,     // quadratic, slow start
+        EASE_OUT,    // quadratic, slow end
+        EASE_IN_OUT, // smoothstep
+    };
+
+    void begin(CRGB *fromPixels, CRGB *toPixels);
+    void setEasing(Easing easing);
+    // Fade from the buffer's current contents into 'to' over duration ms. 'from' is the current effect.
+    // The time starts with the first rendered frame.
+    void start(Effect *from, Effect *to, uint8_t fromBrightness, uint8_t toBrightness, uint32_t duration,
+               LedBuffer &buffer);
+    // Stop where it is, e.g. for a change that has to show at once. Ends the outgoing effect and puts the
+    // incoming effect's own frame into the buffer, effects that only repaint what changed draw on from there.
+    void cancel(LedBuffer &buffer);
+    // Render both sides and blend them into the buffer. Returns false once the transition is over,
+    // the buffer then holds the incoming effect's frame.
+    bool render(const FrameTime &time, LedBuffer &buffer);
+
+    bool isActive() const;
+    uint32_t getFrameInterval() const;
+    uint8_t getBrightness() const;
+    // Eased progress of the last rendered frame, 0 to 65535
+    uint16_t getProgress() const;
+
+    static uint16_t ease(Easing easing, uint16_t t);
+
+private:
+    void _stop();
+
+    CRGB *_fromPixels = nullptr;
+    CRGB *_toPixels = nullptr;
+    Effect *_from = nullptr; // nullptr while the outgoing side is a snapshot
+    Effect *_to = nullptr;
+    Easing _easing = EASE_IN_OUT;
+    uint8_t _fromBrightness = 0;
+    uint8_t _toBrightness = 0;
+    uint8_t _brightness = 0;
+    uint16_t _progress = 0;
+    uint32_t _startTime = 0; // ms
+    uint32_t _duration = 0;  // ms
+    bool _started = false;
+    bool _active = false;
+};
+
+#endif
@@ -0,0 +1,82 @@
+/*"""
+
+ LED Layout:
+ How the logical strip the effects draw on is wired to the OctoWS2811 pins. Each pin drives one run of
+ consecutive logical LEDs, optionally wired from its last LED back to its first (serpentine). OctoWS2811
+ clocks all pins out in parallel, so a frame takes as long as the longest run instead of the whole strip.
+
+   byte pinList[2] = {7, 8};
+   constexpr StripRun wiring[2] = {{0, 124, false}, {124, 123, true}};
+   static constexpr LedMap<LED_COUNT> ledMap(wiring, 2);     // generated at compile time, lives in flash
+   static_assert(ledMap.valid, "every LED on exactly one pin");
+   output.setLayout(ledMap.physical);
+
+ The drawing memory holds one strip of ledMap.ledsPerStrip pixels per pin, one after the other, as in the
+ Teensy 4 OctoWS2811 library. Slots past the end of a shorter run are clocked out but never written.
+
+"""*/
+#ifndef LedLayout_H
+#define LedLayout_H
+#include <inttypes.h>
+
+// OctoWS2811 drives at most 8 pins in parallel
+static const uint8_t LED_LAYOUT_MAX_PINS = 8;
+
+// Part of the logical strip on one pin
+struct StripRun {
+    uint16_t first; // first logical LED
+    uint16_t count;
+    bool reversed; // the pin is connected to the LED first + count - 1
+};
+
+// Strip length OctoWS2811 has to be configured with
+constexpr uint16_t longestRun(const StripRun *runs, uint8_t pinCount) {
+    uint16_t longest = 0;
+    for (uint8_t pin = 0; pin < pinCount; pin++)
+        longest = runs[pin].count > longest ? runs[pin].count : longest;
+    return longest;
+}
+
+// Run of one pin when ledCount LEDs are split as evenly as possible over pinCount pins,
+// every other run reversed if the strip snakes back and forth
+constexpr StripRun splitRun(uint16_t ledCount, uint8_t pinCount, uint8_t pin, bool serpentine) {
+    return {(uint16_t)((uint32_t)ledCount * pin / pinCount),
+            (uint16_t)((uint32_t)ledCount * (pin + 1) / pinCount - (uint32_t)ledCount * pin / pinCount),
+            serpentine && (pin & 1)};
+}
+
+// Microseconds to clock out one frame: 24 bits at 1.25 us per LED of the longest run, plus the 300 us latch
+constexpr uint32_t wireTime(uint16_t ledsPerStrip) { return ledsPerStrip * 30 + 300; }
+
+// Drawing memory pixel of every logical LED. valid is false if a LED is on no pin, on two pins,
+// or a run reaches past the end of the strip.
+template <uint16_t LedCount>
+struct LedMap {
+    uint16_t physical[LedCount];
+    uint16_t ledsPerStrip;
+    bool valid;
+
+    constexpr LedMap(const StripRun *runs, uint8_t pinCount)
+        : physical(), ledsPerStrip(longestRun(runs, pinCount)), valid(pinCount > 0 && pinCount <= LED_LAYOUT_MAX_PINS) {
+        for (uint16_t led = 0; led < LedCount; led++)
+            physical[led] = 0xFFFF;
+        for (uint8_t pin = 0; pin < pinCount; pin++) {
+            const StripRun &run = runs[pin];
+            for (uint16_t i = 0; i < run.count; i++) {
+                uint32_t led = (uint32_t)run.first + i;
+                if (led >= LedCount || physical[led] != 0xFFFF) {
+                    valid = false;
+                    continue;
+                }
+                physical[led] = pin * ledsPerStrip + (run.reversed ? run.count - 1 - i : i);
+            }
+        }
+        for (uint16_t led = 0; led < LedCount; led++) {
+            if (physical[led] == 0xFFFF)
+                valid = false;
+        }
+    }
+    inline uint16_t operator[](uint16_t led) const { return physical[led]; }
+};
+
+#endif
@@ -13,6 +13,7 @@ _separator = '#'
 void SerialHandler::update() {
     _printPeriodically(_printFrequency, _debug);
     _receiveNonBlocking();
+    _updateStats();
 }
 
 void SerialHandler::setSerial(Stream &serial) {
@@ -28,82 +29,112 @@ void SerialHandler::setStartMarker(char startMarker) { _startMarker = startMarke
 
 void SerialHandler::setSeperator(char seperator) { _separator = seperator; }
 
+// Drain everything the UART has into the ring buffer, then parse up to _receiveBudget bytes of it.
+// Bytes over the budget wait in the ring buffer for the next update instead of piling up in the UART.
 void SerialHandler::_receiveNonBlocking() {
-    static boolean recvInProgress = false;
-    static byte ndx = 0;
-    char rc;
+    int available = _serial->available();
+    while (available-- > 0) {
+        uint16_t next = (_ringHead + 1) & _ringMask;
+        if (next == _ringTail) {
+            _overflows++;
+            break;
+        }
+        _ring[_ringHead] = _serial->read();
+        _ringHead = next;
+    }
 
-    if (_serial->available() <= 0)
-        return;
+    uint16_t budget = _receiveBudget;
+    while (_ringTail != _ringHead && budget > 0) {
+        char rc = _ring[_ringTail];
+        _ringTail = (_ringTail + 1) & _ringMask;
+        budget--;
+        _bytesInWindow++;
+        _receiveByte(rc);
+    }
+}
 
-    rc = _serial->read();
-    if (recvInProgress == true) {
+void SerialHandler::_receiveByte(char rc) {
+    if (_recvInProgress == true) {
         if (rc != _endMarker) {
-            _receivedChars[ndx] = rc;
-            ndx++;
-            if (ndx >= _numChars) {
+            _receivedChars[_ndx] = rc;
+            _ndx++;
+            if (_ndx >= _numChars) {
                 this->pln("Buffer Overflow");
-                ndx = _numChars - 1;
+                _overflows++;
+                _ndx = _numChars - 1;
             }
         } else {
             // digitalWrite(13, !digitalRead(13));
-            _receivedChars[ndx] = '\0'; // terminate the string when the end marker arrives
-            recvInProgress = false;
-            ndx = 0;
-            this->parseString(_receivedChars);
+            _receivedChars[_ndx] = '\0'; // terminate the string when the end marker arrives
+            _recvInProgress = false;
+            _messagesInWindow++;
+            this->parseString(_receivedChars, _ndx);
+            _ndx = 0;
         }
     } else if (rc == _startMarker) {
-        recvInProgress = true;
+        _recvInProgress = true;
     } else {
         Serial.print(rc);
     }
 }
 
-void SerialHandler::parseString(char *string) {
-    const char seperator[2] = {_separator, '\0'};
-    char messageType = string[0];
-    // Remove the first character from the string using memmove. First character is the message type.
-    memmove(string, string + 1, strlen(string));
-
-    switch (messageType) {
-    case 'C':{
-
-        // Parse the message in the following format: <Cff365d>
-        // Start, end and messagetype characters are already removed. So it is ff365d which is a hex color code.
-        // Convert the hex color code to CRGB and set the wholeStripColor to that color. (Do not use strtoul)
-        // who
-        long hexColor = strtol(string, NULL, 16);
-        byte r = (hexColor >> 16) & 0xFF;
-        byte g = (hexColor >> 8) & 0xFF;
-        byte b = hexColor & 0xFF;
-        wholeStripColor = CRGB(r, g, b);
-        Serial.print(string);
+void SerialHandler::_updateStats() {
+    uint32_t elapsed = millis() - _statsTimer;
+    if (elapsed < 1000)
+        return;
+    _bytesPerSecond = _bytesInWindow * 1000.0f / elapsed;
+    _messagesPerSecond = _messagesInWindow * 1000.0f / elapsed;
+    _bytesInWindow = 0;
+    _messagesInWindow = 0;
+    _statsTimer = millis();
+}
+
+void SerialHandler::setReceiveBudget(uint16_t bytesPerUpdate) { _receiveBudget = bytesPerUpdate; }
+
+float SerialHandler::getBytesPerSecond() { return _bytesPerSecond; }
+float SerialHandler::getMessagesPerSecond() { return _messagesPerSecond; }
+// Ring buffer full while the UART still had data, or a message longer than the message buffer
+uint32_t SerialHandler::getOverflows() { return _overflows; }
+
+// Handlers for the ASCII messages, see messageTable below
+struct SerialMessages {
+    // <Cff365d>: color of the whole strip as a hex color code
+    static void setColor(SerialHandler &handler, uint32_t value) {
+        byte r = (value >> 16) & 0xFF;
+        byte g = (value >> 8) & 0xFF;
+        byte b = value & 0xFF;
+        handler.wholeStripColor = CRGB(r, g, b);
+        Serial.print(value, HEX);
         Serial.print(" ");
         Serial.print(r);
         Serial.print(" ");
         Serial.print(g);
         Serial.print(" ");
         Serial.println(b);
-
-        break;
-    }
-    case 'M': {
-
-        // Parse the message in the following format: <M0>
-        // Start, end and messagetype characters are already removed. So it is 0 which is a number.
-        // Set the mode to that number.
-        // who
-        int val = atoi(string);
-        *mode = val;
-        Serial.print(string);
-        Serial.print(" ");
-        Serial.println(val);
-        break;
     }
+    // <M0>: LED mode
+    static void setMode(SerialHandler &handler, uint32_t value) {
+        if (handler.mode)
+            *handler.mode = value;
+        Serial.println(value);
     }
-    return;
+};
+
+static constexpr MessageDescriptor<SerialHandler> messageTable[] = {
+    // type, base, min digits, max digits, min value, max value, handler
+    {'C', 16, 6, 6, 0, 0xFFFFFF, &SerialMessages::setColor},
+    {'M', 10, 1, 3, 0, 255, &SerialMessages::setMode},
+};
+
+// Parse the body of one ASCII message in place, e.g. "R255" for <R255>
+void SerialHandler::parseString(const char *message, uint8_t length) {
+    if (parseMessage(messageTable, *this, message, length) != MESSAGE_OK)
+        _rejectedMessages++;
 }
 
+// Malformed, unknown or out of range ASCII messages
+uint32_t SerialHandler::getRejectedMessages() { return _rejectedMessages; }
+
 void SerialHandler::_printPeriodically(float freq, bool debug = false) {
     if (freq <= 0)
         return;
@@ -16,6 +16,7 @@
 #define SerialHandler_H
 #include "Arduino.h"
 #include "FastLED.h"
+#include "MessageParser.h"
 #include "advancedSerial.h"
 #include <inttypes.h>
 
@@ -25,6 +26,8 @@ enum SerialConnectionApp {
 };
 
 class SerialHandler : public advancedSerial {
+    friend struct SerialMessages;
+
 public:
     void update();
     void setSerial(Stream &serial);
@@ -34,10 +37,15 @@ public:
     void setSeperator(char seperator);
     void setDebug(bool debug);
     void setPrintFrequency(float printFrequency);
-    void parseString(char *string);
+    void setReceiveBudget(uint16_t bytesPerUpdate);
+    void parseString(const char *message, uint8_t length);
+    uint32_t getRejectedMessages();
     char getStartMarker();
     char getEndMarker();
     Stream &getSerial();
+    float getBytesPerSecond();
+    float getMessagesPerSecond();
+    uint32_t getOverflows();
     CRGB wholeStripColor = CRGB::Black;
     
 
@@ -55,7 +63,27 @@ private:
     char _receivedChars[_numChars];
     void _printPeriodically(float frequency, bool debug);
     void _receiveNonBlocking(void);
-    int* mode;
+    void _receiveByte(char rc);
+    void _updateStats(void);
+
+    // Received bytes wait here until they are parsed. Size must be a power of two.
+    static const uint16_t _ringSize = 256;
+    static const uint16_t _ringMask = _ringSize - 1;
+    uint8_t _ring[_ringSize];
+    uint16_t _ringHead = 0;
+    uint16_t _ringTail = 0;
+    uint16_t _receiveBudget = 128;
+    bool _recvInProgress = false;
+    byte _ndx = 0;
+
+    uint32_t _statsTimer = 0;
+    uint32_t _bytesInWindow = 0;
+    uint32_t _messagesInWindow = 0;
+    float _bytesPerSecond = 0;
+    float _messagesPerSecond = 0;
+    uint32_t _overflows = 0;
+    uint32_t _rejectedMessages = 0;
+    int* mode = nullptr;
 };
 
 #include "Arduino.h"
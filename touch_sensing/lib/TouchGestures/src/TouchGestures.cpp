@@ -0,0 +1,163 @@
+#include "TouchGestures.h"
+
+// Ramp steps are counted in millionths, per microsecond held
+static const uint32_t RAMP_UNIT = 1000000;
+
+void GestureRecognizer::begin(const GestureTiming &timing) {
+    _timing = timing;
+    _state = IDLE;
+    _pads = 0;
+    _count = 0;
+    _started = false;
+}
+
+void GestureRecognizer::onTouch(uint8_t pads, uint32_t micros) {
+    // Whatever ran out before this event comes first
+    tick(micros);
+    micros = _now;
+    uint8_t pressed = pads & ~_pads;
+    _pads = pads;
+
+    switch (_state) {
+    case IDLE:
+        if (pressed)
+            _press(pads, micros);
+        break;
+    case TAP_WAIT:
+        if (pressed == _pad && pads == _pad) {
+            _state = DOWN;
+            _secondTap = true;
+            _since = micros;
+        } else if (pressed) {
+            // Another pad: the tap stands alone
+            _emit(GESTURE_TAP, _pad, micros);
+            _press(pads, micros);
+        }
+        break;
+    case DOWN:
+        if (pads & ~_pad) {
+            if (_secondTap)
+                _emit(GESTURE_TAP, _pad, micros);
+            _emit(GESTURE_TWO_FINGER, pads | _pad, micros);
+            _state = BLOCKED;
+        } else if (!pads) {
+            if (micros - _since > _timing.tapMs * 1000UL) {
+                // Too long for a tap, too short for a long press
+                if (_secondTap)
+                    _emit(GESTURE_TAP, _pad, micros);
+                _state = IDLE;
+            } else if (_secondTap) {
+                _emit(GESTURE_DOUBLE_TAP, _pad, micros);
+                _state = IDLE;
+            } else {
+                _state = TAP_WAIT;
+                _since = micros;
+            }
+        }
+        break;
+    case HOLD:
+        if (!(pads & _pad)) {
+            _emit(GESTURE_HOLD_END, _pad, micros);
+            _state = pads ? BLOCKED : IDLE;
+        }
+        break;
+    case BLOCKED:
+        if (!pads)
+            _state = IDLE;
+        break;
+    }
+}
+
+void GestureRecognizer::tick(uint32_t micros) {
+    if (_started && (int32_t)(micros - _now) < 0)
+        micros = _now;
+    _now = micros;
+    _started = true;
+    if (_state == TAP_WAIT) {
+        uint32_t timeout = _timing.doubleTapMs * 1000UL;
+        if (micros - _since >= timeout) {
+            _emit(GESTURE_TAP, _pad, _since + timeout);
+            _state = IDLE;
+        }
+    } else if (_state == DOWN) {
+        uint32_t timeout = _timing.longPressMs * 1000UL;
+        if (micros - _since >= timeout) {
+            uint32_t at = _since + timeout;
+            if (_secondTap)
+                _emit(GESTURE_TAP, _pad, at);
+            _emit(GESTURE_LONG_PRESS, _pad, at);
+            _state = HOLD;
+            // The ramp starts at the long press, not at this tick
+            _since = at;
+            _rampCarry = 0;
+        }
+    }
+    if (_state == HOLD && (_timing.rampPads & _pad)) {
+        // Steps by the time held, carried over between ticks, so the loop rate does not matter
+        uint32_t elapsed = micros - _since;
+        _since = micros;
+        uint64_t carry = _rampCarry + (uint64_t)elapsed * _timing.rampPerSecond;
+        uint32_t steps = carry / RAMP_UNIT;
+        _rampCarry = carry % RAMP_UNIT;
+        if (steps)
+            _emit(GESTURE_RAMP, _pad, micros, steps > UINT16_MAX ? UINT16_MAX : steps);
+    }
+}
+
+bool GestureRecognizer::pop(Gesture &gesture) {
+    if (!_count)
+        return false;
+    gesture = _queue[_first];
+    _first = (_first + 1) % queueSize;
+    _count--;
+    return true;
+}
+
+const char *GestureRecognizer::getName(GestureType type) {
+    switch (type) {
+    case GESTURE_TAP:
+        return "tap";
+    case GESTURE_DOUBLE_TAP:
+        return "double-tap";
+    case GESTURE_LONG_PRESS:
+        return "long-press";
+    case GESTURE_RAMP:
+        return "ramp";
+    case GESTURE_HOLD_END:
+        return "hold-end";
+    case GESTURE_TWO_FINGER:
+        return "two-finger";
+    }
+    return "?";
+}
+
+// A new press from nothing: one pad starts a gesture, more than one at once are two fingers
+void GestureRecognizer::_press(uint8_t pads, uint32_t time) {
+    if (pads & (pads - 1)) {
+        _emit(GESTURE_TWO_FINGER, pads, time);
+        _state = BLOCKED;
+        return;
+    }
+    _state = DOWN;
+    _pad = pads;
+    _secondTap = false;
+    _since = time;
+}
+
+void GestureRecognizer::_emit(GestureType type, uint8_t pads, uint32_t time, uint16_t steps) {
+    // Ramp steps nobody popped yet go into the pending ramp
+    if (type == GESTURE_RAMP && _count) {
+        Gesture &last = _queue[(_first + _count - 1) % queueSize];
+        if (last.type == GESTURE_RAMP && last.pads == pads && last.steps <= UINT16_MAX - steps) {
+            last.steps += steps;
+            last.micros = time;
+            return;
+        }
+    }
+    if (_count == queueSize) {
+        _dropped++;
+        return;
+    }
+    _queue[(_first + _count) % queueSize] = {time, type, pads, steps};
+    _count++;
+}
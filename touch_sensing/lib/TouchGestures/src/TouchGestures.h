@@ -0,0 +1,104 @@
+/*"""
+
+ Touch Gestures:
+ Turns the touched pads of the CAP1188 into gestures, by the timestamps of the touch events and not by
+ how often the loop runs. A tap, double tap, long press or two-finger press comes out the same at any
+ loop rate, and a held long press ramps at a fixed number of steps per second.
+
+   GESTURE_TAP         pressed and let go within tapMs, no second tap within doubleTapMs after it
+   GESTURE_DOUBLE_TAP  a second tap of the same pad within doubleTapMs of the first
+   GESTURE_LONG_PRESS  held for longPressMs
+   GESTURE_RAMP        while a long press of one of the rampPads is held, rampPerSecond steps per second
+   GESTURE_HOLD_END    the long-pressed pad was let go
+   GESTURE_TWO_FINGER  a second pad touched before the first one became a long press
+
+ One gesture is tracked at a time: after a two-finger press, or while a long press is held, other pads
+ are ignored until all pads are let go. Every call is O(1), a handful of compares on the current state.
+
+ Plain C++ without Arduino, so recorded traces replay on the host (native/replay).
+
+   gestures.begin();
+   ...
+   gestures.onTouch(event.pads, event.micros);   // for every touch event, in order
+   gestures.tick(micros());                      // once per loop pass
+   Gesture gesture;
+   while (gestures.pop(gesture))
+       ...
+
+"""*/
+#ifndef TouchGestures_H
+#define TouchGestures_H
+#include <inttypes.h>
+
+enum GestureType : uint8_t {
+    GESTURE_TAP,
+    GESTURE_DOUBLE_TAP,
+    GESTURE_LONG_PRESS,
+    GESTURE_RAMP,
+    GESTURE_HOLD_END,
+    GESTURE_TWO_FINGER,
+};
+
+struct Gesture {
+    uint32_t micros;  // when it was recognized, on the clock of the touch events
+    GestureType type;
+    uint8_t pads;     // the pad's bit, both bits for two fingers
+    uint16_t steps;   // GESTURE_RAMP: steps since the previous one
+};
+
+struct GestureTiming {
+    uint16_t tapMs = 250;         // longest press that is still a tap
+    uint16_t doubleTapMs = 250;   // longest gap between the two taps of a double tap
+    uint16_t longPressMs = 500;   // a press this long is a long press
+    uint16_t rampPerSecond = 64;  // ramp steps per second while a long press is held
+    uint8_t rampPads = 0xFF;      // pads that ramp after a long press
+};
+
+class GestureRecognizer {
+public:
+    static const uint8_t queueSize = 8;
+
+    void begin(const GestureTiming &timing = GestureTiming());
+    // The touched pads changed, one bit per pad. A time before one already seen counts as that one,
+    // an event stamped by the interrupt can be newer than the loop's last tick.
+    void onTouch(uint8_t pads, uint32_t micros);
+    // Timeouts and ramp steps up to now, once per loop pass
+    void tick(uint32_t micros);
+    bool pop(Gesture &gesture);
+
+    uint8_t getPads() const { return _pads; }
+    const GestureTiming &getTiming() const { return _timing; }
+    uint32_t getDropped() const { return _dropped; }
+    static const char *getName(GestureType type);
+
+private:
+    enum State : uint8_t {
+        IDLE,     // nothing touched, or nothing left to wait for
+        DOWN,     // one pad down, tap or long press to be seen
+        TAP_WAIT, // tapped once, a double tap may follow
+        HOLD,     // long press held, ramping
+        BLOCKED,  // ignore everything until all pads are let go
+    };
+
+    void _press(uint8_t pads, uint32_t time);
+    void _emit(GestureType type, uint8_t pads, uint32_t time, uint16_t steps = 0);
+
+    GestureTiming _timing;
+    State _state = IDLE;
+    uint8_t _pads = 0;
+    // The pad the gesture is about, and whether its press is the second one of a double tap
+    uint8_t _pad = 0;
+    bool _secondTap = false;
+    // The press in DOWN, the release in TAP_WAIT, the last ramp step in HOLD
+    uint32_t _since = 0;
+    uint32_t _rampCarry = 0;
+    uint32_t _now = 0;
+    bool _started = false;
+
+    Gesture _queue[queueSize];
+    uint8_t _first = 0;
+    uint8_t _count = 0;
+    uint32_t _dropped = 0;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "TouchSensor.h"
+
+// Repeat rate enable, one bit per pad: interrupts every 175 ms while a pad is held
+static const uint8_t CAP1188_REPEAT_ENABLE = 0x28;
+
+TouchSensor *TouchSensor::_instance = nullptr;
+
+void TouchSensor::begin(Adafruit_CAP1188 &cap, uint8_t alertPin) {
+    _cap = &cap;
+    _alertPin = alertPin;
+    _instance = this;
+    // Only touches and releases raise an alert
+    _cap->writeRegister(CAP1188_REPEAT_ENABLE, 0);
+    _main = _cap->readRegister(CAP1188_MAIN) & ~CAP1188_MAIN_INT;
+    // ALERT is open drain and active low
+    pinMode(_alertPin, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(_alertPin), _alert, FALLING);
+    // Whatever is already touched, and release an alert raised before the handler was attached
+    noInterrupts();
+    _service(micros());
+    interrupts();
+}
+
+void TouchSensor::update() {
+    // ALERT stays low only until the handler clears INT
+    if (digitalRead(_alertPin) != LOW)
+        return;
+    _missedAlerts++;
+    noInterrupts();
+    _service(micros());
+    interrupts();
+}
+
+void TouchSensor::_alert() {
+    _instance->_service(micros());
+}
+
+// Latched status, clear INT, status again: touches since the alert, then releases from before the clear
+void TouchSensor::_service(uint32_t time) {
+    uint32_t start = micros();
+    uint8_t latched = _cap->readRegister(CAP1188_SENINPUTSTATUS);
+    _cap->writeRegister(CAP1188_MAIN, _main);
+    uint8_t current = _cap->readRegister(CAP1188_SENINPUTSTATUS);
+    _readMicros = micros() - start;
+    _reads++;
+    // Pads that were touched and let go again in between are kept apart from ones already released
+    _changed(_pads | latched, time);
+    _changed(current, time);
+}
+
+// One event per pad that changed, lowest pad first
+void TouchSensor::_changed(uint8_t pads, uint32_t time) {
+    uint8_t state = _pads;
+    uint8_t changed = pads ^ state;
+    for (uint8_t pad = 0; changed; pad++, changed >>= 1) {
+        if (!(changed & 1))
+            continue;
+        state ^= 1 << pad;
+        _queue.push({time, pad, (state & (1 << pad)) != 0, state});
+    }
+    _pads = state;
+}
@@ -0,0 +1,139 @@
+/*"""
+
+ Touch Sensor:
+ Interrupt-driven driver for the CAP1188. The sensor pulls its ALERT line low when a pad is touched or
+ released. The interrupt handler reads the pads right then, over I2C or hardware SPI, and pushes one
+ timestamped event per pad that changed into a lock-free queue. The bus is only read when the sensor
+ says something changed, and never from the render loop: the loop pops the events whenever it gets there.
+
+ Each alert is serviced as: read the input status, clear the INT bit (which releases ALERT), read the
+ status again. The first read holds touches latched since the alert, the second one releases that
+ happened before INT was cleared, so a tap shorter than the service time still comes out as touch and
+ release. Anything after the clear raises the next alert. Repeat interrupts while a pad is held are
+ switched off, the events carry the state.
+
+   touchSensor.begin(cap, CAP1188_ALERT);
+   ...
+   touchSensor.update();                    // once per loop pass, catches an alert whose edge was lost
+   TouchEvent event;
+   while (touchSensor.pop(event))
+       ...
+
+ TouchLatency collects the time from a recognized gesture (see TouchGestures.h) to the frame that shows it.
+
+"""*/
+#ifndef TouchSensor_H
+#define TouchSensor_H
+#include <Adafruit_CAP1188.h>
+#include <Arduino.h>
+#include <atomic>
+#include <inttypes.h>
+
+struct TouchEvent {
+    uint32_t micros; // when the sensor raised ALERT
+    uint8_t pad;     // 0..7
+    bool touched;    // touched or released
+    uint8_t pads;    // every pad touched after this event, one bit each
+};
+
+// One producer (the interrupt handler) and one consumer (the main loop), each side only writes its
+// own index, so neither needs a lock. Size must be a power of two, one slot always stays free.
+template <uint8_t Size>
+class TouchQueue {
+public:
+    static const uint8_t mask = Size - 1;
+
+    bool push(const TouchEvent &event) {
+        uint8_t head = _head;
+        if (((head + 1) & mask) == _tail) {
+            _dropped++;
+            return false;
+        }
+        _events[head] = event;
+        // The event is in place before the consumer can see the new head
+        std::atomic_signal_fence(std::memory_order_release);
+        _head = (head + 1) & mask;
+        return true;
+    }
+
+    bool pop(TouchEvent &event) {
+        uint8_t tail = _tail;
+        if (tail == _head)
+            return false;
+        std::atomic_signal_fence(std::memory_order_acquire);
+        event = _events[tail];
+        // The event is copied out before the producer can reuse its slot
+        std::atomic_signal_fence(std::memory_order_release);
+        _tail = (tail + 1) & mask;
+        return true;
+    }
+
+    uint8_t pending() const { return (_head - _tail) & mask; }
+    uint32_t getDropped() const { return _dropped; }
+
+private:
+    TouchEvent _events[Size];
+    volatile uint8_t _head = 0;
+    volatile uint8_t _tail = 0;
+    volatile uint32_t _dropped = 0;
+};
+
+class TouchSensor {
+public:
+    static const uint8_t queueSize = 32;
+
+    // cap has to be begun already, alertPin is wired to the sensor's open-drain ALERT output
+    void begin(Adafruit_CAP1188 &cap, uint8_t alertPin);
+    // Call once per loop pass. ALERT still low here means its edge was lost, it is serviced from here.
+    void update();
+    bool pop(TouchEvent &event) { return _queue.pop(event); }
+
+    // Pads touched as of the last read
+    uint8_t getPads() const { return _pads; }
+    uint32_t getReads() const { return _reads; }
+    // Microseconds the last alert kept the interrupt handler on the bus
+    uint32_t getReadMicros() const { return _readMicros; }
+    uint32_t getMissedAlerts() const { return _missedAlerts; }
+    uint32_t getDropped() const { return _queue.getDropped(); }
+
+private:
+    static void _alert();
+    void _service(uint32_t time);
+    void _changed(uint8_t pads, uint32_t time);
+
+    static TouchSensor *_instance;
+    Adafruit_CAP1188 *_cap = nullptr;
+    uint8_t _alertPin = 0;
+    uint8_t _main = 0;
+    volatile uint8_t _pads = 0;
+    volatile uint32_t _reads = 0;
+    volatile uint32_t _readMicros = 0;
+    uint32_t _missedAlerts = 0;
+    TouchQueue<queueSize> _queue;
+};
+
+// Gesture-to-light latency: from the ALERT edge of the touch that completed a gesture, or the end of its
+// timeout for a long press, to the frame that shows it handed to the LEDs
+class TouchLatency {
+public:
+    void record(uint32_t micros) {
+        _count++;
+        _sum += micros;
+        _min = min(_min, micros);
+        _max = max(_max, micros);
+    }
+    void reset() { *this = TouchLatency(); }
+
+    uint32_t getCount() const { return _count; }
+    uint32_t getMin() const { return _count ? _min : 0; }
+    uint32_t getMax() const { return _max; }
+    uint32_t getAverage() const { return _count ? _sum / _count : 0; }
+
+private:
+    uint32_t _count = 0;
+    uint32_t _min = UINT32_MAX;
+    uint32_t _max = 0;
+    uint64_t _sum = 0;
+};
+
+#endif
@@ -0,0 +1,160 @@
+// Host replay of recorded touch traces through the gesture recognizer ([env:native_replay]).
+// A trace is the "touch <micros> <pads>" lines the firmware logs with ADVANCED_SERIAL_LOG_LEVEL >= 1,
+// anything else in a captured log is skipped. Traces may list the gestures they have to produce as
+// "expect <gesture> <pads> [ramp steps]" lines, ramps of one hold summed up.
+//
+// Every trace is replayed with the loop running every 0.1, 1, 7, 20 and 50 ms, and once more each with
+// events stamped up to half a pass after the loop's tick, as the interrupt can. All of them have to
+// give the same gestures, and the expected ones if there are any. Exits 1 if not.
+//
+//   pio run -e native_replay && .pio/build/native_replay/program native/traces/*.trace
+#include "TouchGestures.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct TouchSample {
+    uint32_t micros;
+    uint8_t pads;
+};
+
+struct Trace {
+    std::vector<TouchSample> touches;
+    std::vector<Gesture> expected;
+};
+
+static const uint32_t loopIntervals[] = {100, 1000, 7000, 20000, 50000};
+// Loop passes keep going this long after the last touch, for the timeouts
+static const uint32_t TAIL_US = 2000000;
+
+static bool parseGesture(const char *name, GestureType &type) {
+    for (uint8_t t = GESTURE_TAP; t <= GESTURE_TWO_FINGER; t++) {
+        if (strcmp(name, GestureRecognizer::getName((GestureType)t)) == 0) {
+            type = (GestureType)t;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool loadTrace(const char *path, Trace &trace) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("%s: cannot open\n", path);
+        return false;
+    }
+    char line[256];
+    uint32_t number = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), file)) {
+        number++;
+        unsigned long micros;
+        unsigned pads, steps = 0;
+        char name[32];
+        if (sscanf(line, "touch %lu %u", &micros, &pads) == 2) {
+            trace.touches.push_back({(uint32_t)micros, (uint8_t)pads});
+        } else if (sscanf(line, "expect %31s %u %u", name, &pads, &steps) >= 2) {
+            Gesture gesture = {0, GESTURE_TAP, (uint8_t)pads, (uint16_t)steps};
+            if (!parseGesture(name, gesture.type)) {
+                printf("%s:%u: unknown gesture %s\n", path, number, name);
+                ok = false;
+            }
+            trace.expected.push_back(gesture);
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+// Ramps of one hold come out in as many pieces as there were loop passes, only their sum counts
+static void collect(GestureRecognizer &gestures, std::vector<Gesture> &out) {
+    Gesture gesture;
+    while (gestures.pop(gesture)) {
+        if (gesture.type == GESTURE_RAMP && !out.empty() && out.back().type == GESTURE_RAMP && out.back().pads == gesture.pads) {
+            out.back().steps += gesture.steps;
+            continue;
+        }
+        out.push_back(gesture);
+    }
+}
+
+static std::vector<Gesture> replay(const Trace &trace, uint32_t interval, uint32_t ahead) {
+    GestureRecognizer gestures;
+    gestures.begin();
+    std::vector<Gesture> out;
+    if (trace.touches.empty())
+        return out;
+    uint32_t start = trace.touches.front().micros;
+    uint32_t end = trace.touches.back().micros - start + TAIL_US;
+    size_t next = 0;
+    // Events that arrived since the previous pass, then the pass itself
+    for (uint32_t now = 0; now <= end; now += interval) {
+        while (next < trace.touches.size() && trace.touches[next].micros - start <= now + ahead) {
+            gestures.onTouch(trace.touches[next].pads, trace.touches[next].micros);
+            next++;
+        }
+        gestures.tick(start + now);
+        collect(gestures, out);
+    }
+    return out;
+}
+
+static bool same(const Gesture &a, const Gesture &b) {
+    return a.type == b.type && a.pads == b.pads && (a.type != GESTURE_RAMP || a.steps == b.steps);
+}
+
+static std::string describe(const Gesture &gesture) {
+    char text[64];
+    if (gesture.type == GESTURE_RAMP)
+        snprintf(text, sizeof(text), "%s %u %u", GestureRecognizer::getName(gesture.type), gesture.pads, gesture.steps);
+    else
+        snprintf(text, sizeof(text), "%s %u", GestureRecognizer::getName(gesture.type), gesture.pads);
+    return text;
+}
+
+static bool compare(const char *path, const char *what, const std::vector<Gesture> &expected, const std::vector<Gesture> &got) {
+    for (size_t i = 0; i < expected.size() || i < got.size(); i++) {
+        if (i < expected.size() && i < got.size() && same(expected[i], got[i]))
+            continue;
+        printf("%s: %s, gesture %zu: expected %s, got %s\n", path, what, i + 1, i < expected.size() ? describe(expected[i]).c_str() : "nothing",
+               i < got.size() ? describe(got[i]).c_str() : "nothing");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <trace>...\n", argv[0]);
+        return 2;
+    }
+    bool ok = true;
+    for (int arg = 1; arg < argc; arg++) {
+        const char *path = argv[arg];
+        Trace trace;
+        if (!loadTrace(path, trace)) {
+            ok = false;
+            continue;
+        }
+        std::vector<Gesture> reference = replay(trace, loopIntervals[1], 0);
+        printf("%s: %zu touch events\n", path, trace.touches.size());
+        uint32_t start = trace.touches.empty() ? 0 : trace.touches.front().micros;
+        for (const Gesture &gesture : reference)
+            printf("  %8.3f s  %s\n", (gesture.micros - start) / 1e6, describe(gesture).c_str());
+
+        bool traceOk = true;
+        for (uint32_t interval : loopIntervals) {
+            char what[64];
+            snprintf(what, sizeof(what), "loop every %.1f ms", interval / 1000.0);
+            traceOk &= compare(path, what, reference, replay(trace, interval, 0));
+            snprintf(what, sizeof(what), "loop every %.1f ms, events ahead of it", interval / 1000.0);
+            traceOk &= compare(path, what, reference, replay(trace, interval, interval / 2));
+        }
+        if (!trace.expected.empty())
+            traceOk &= compare(path, "expected", trace.expected, reference);
+        printf("  %s\n", traceOk ? "ok" : "FAILED");
+        ok &= traceOk;
+    }
+    return ok ? 0 : 1;
+}
@@ -1,13 +1,20 @@
 // Main code for the cloud LED lamp project
 // Cycle between different modes of LED lighting based on touch input
+#include "Compositor.h"
+#include "Effects.h"
+#include "OutputStage.h"
+#include "SerialHandler.h"
+#include "TouchGestures.h"
+#include "TouchSensor.h"
+#include "advancedSerial.h"
 #include <Adafruit_CAP1188.h>
 #include <Arduino.h>
 #include <OctoWS2811.h>
 #include <SPI.h>
 #include <Wire.h>
-#include "SerialHandler.h"
 
 #define LED_COUNT 248
+static_assert(LED_COUNT <= EFFECTS_MAX_LEDS, "EFFECTS_MAX_LEDS in platformio.ini has to cover every LED");
 
 // Reset Pin is used for I2C or SPI
 #define CAP1188_RESET 9
@@ -21,7 +28,22 @@
 #define CAP1188_MISO 12
 #define CAP1188_CLK 13
 
+// Open-drain ALERT output, low when a pad was touched or released
+#define CAP1188_ALERT 2
+
+// I2C at 400 kHz, or hardware SPI on the pins above with -D CAP1188_SPI
+#ifdef CAP1188_SPI
+Adafruit_CAP1188 cap = Adafruit_CAP1188(CAP1188_CS, CAP1188_RESET);
+#else
 Adafruit_CAP1188 cap = Adafruit_CAP1188();
+#endif
+// Reads the sensor from its ALERT interrupt, the loop only pops the queued events
+TouchSensor touchSensor;
+TouchLatency touchLatency;
+// Taps, long presses and two-finger presses from the touch events, by their timestamps
+GestureRecognizer gestures;
+// Reports go through the deferred logger, drained once per loop pass
+advancedLogger logger;
 
 const int numPins = 1;
 byte pinList[numPins] = {7};
@@ -36,30 +58,48 @@ const int config = WS2811_GRB | WS2811_800kHz;
 
 OctoWS2811 leds(ledsPerStrip, displayMemory, drawingMemory, config, numPins, pinList);
 
+// Logical framebuffer the layers are blended into. Brightness is only applied by the output stage.
+CRGB frame[LED_COUNT];
+LedBuffer buffer = {frame, LED_COUNT};
+OutputStage output;
+// Sampled once per frame, effects only see this time
+FrameClock frameClock;
+
+// Layers from the bottom: the effect of the mode, lightning striking over it, the brightness bar on top.
+// Only LEDs that changed in some layer are blended again, the bar does not re-render the effect below it.
+Compositor compositor;
+Layer &effectLayer = compositor.getLayer(0);
+Layer &lightningLayer = compositor.getLayer(1);
+Layer &barLayer = compositor.getLayer(2);
+CRGB effectPixels[LED_COUNT];
+CRGB lightningPixels[LED_COUNT];
+CRGB barPixels[LED_COUNT];
+uint8_t barAlpha[LED_COUNT];
+// Lightning only, without the thunder background, its own instance next to the thunder mode's
+ThunderEffect lightning;
+
+// The shared effects, see the registry in Effects.h
 enum LedMode { THUNDER,
                SUNLIGHT,
                RAINBOW,
                COLOR,
-               GREEN,
 };
 
 LedMode ledMode = THUNDER;
-LedMode lastMode = THUNDER;
-unsigned long lastModeChangeTime = 0;
-const unsigned long modeChangeCooldown = 1000; // 1 second cooldown
-unsigned long lastTouchTime = 0;
-const unsigned long touchBufferTime = 5000; // 200 ms cooldown
 
-void updateThunderMode();
-void updateSunlightMode(uint32_t color);
-void updateRainbowMode();
-void updateBrightness();
+// Pads of the CAP1188, one bit each
+const uint8_t PAD_BRIGHTER = 0b01;
+const uint8_t PAD_DIMMER = 0b10;
 
-// Add this near the top of the file, with other global variables
-float globalBrightness = 150;          // Current brightness level
+bool handleGesture(const Gesture &gesture);
+void renderFrame();
+void showBrightnessBar(const CRGB &color);
+void reportTouchLatency(unsigned long currentTime);
+
+int globalBrightness = 150;            // Current brightness level
+int brightnessBeforeOff = 150;         // Brought back by a double tap
 const int maxBrightness = 255;         // Maximum brightness level
 const int minBrightness = 0;           // Minimum brightness level
-const float brightnessIncrement = 0.5; // Amount to change brightness
 
 void setup() {
     pinMode(LED_BUILTIN, OUTPUT);
@@ -70,287 +110,153 @@ void setup() {
             ;
     }
     Serial.println("CAP1188 found!");
+    logger.setPrinter(Serial);
+#ifndef CAP1188_SPI
+    Wire.setClock(400000);
+#endif
+    touchSensor.begin(cap, CAP1188_ALERT);
+    // Holding a pad ramps the brightness by 64 levels per second
+    GestureTiming timing;
+    timing.rampPads = PAD_BRIGHTER | PAD_DIMMER;
+    timing.rampPerSecond = 64;
+    gestures.begin(timing);
     leds.begin();
     leds.show();
+    output.begin(leds, drawingMemory, LED_COUNT, config);
+
+    compositor.begin(buffer);
+    effectLayer.begin(effectPixels, BLEND_REPLACE);
+    lightning.setBackground(false);
+    lightningLayer.begin(lightningPixels, BLEND_MAX);
+    lightningLayer.setEffect(&lightning);
+    lightningLayer.setEnabled(false);
+    barLayer.begin(barPixels, BLEND_ALPHA, barAlpha);
+    barLayer.setEnabled(false);
 }
 
-// #define RED 0x080000
-// #define GREEN 0x001600
-#define BLUE 0x000016
-#define YELLOW 0x101400
-#define PINK 0x120009
-#define ORANGE 0x100400
-#define CYAN 0x001010
-#define WHITE 0x101010
-
-int colors[] = {RED, GREEN, BLUE, YELLOW, PINK, ORANGE, WHITE};
-
 void loop() {
-    digitalWrite(LED_BUILTIN, millis() % 1000 < 500);
-    uint8_t touched = cap.touched();
-    static bool thresholdReached = false;
-    
-    if (touched && (millis() - lastTouchTime > touchBufferTime)) {
-        unsigned long currentTime = millis();
-        if (!thresholdReached) {
-            lastTouchTime = currentTime;
-            thresholdReached = true;
-        } else if (currentTime - lastTouchTime < touchBufferTime) {
-            // Execute this block if touched for less than touchBufferTime
-            Serial.println("Quick touch detected!");
-            // Add your desired quick touch action here
-        }
-    }
-
-    else if ((touched & 0b00000011) == 0b00000011) {
-        unsigned long currentTime = millis();
-        if (currentTime - lastModeChangeTime > modeChangeCooldown) {
-            // Change LED mode beetween 0 , 1 , 2. Do not use 3 and 4
-            ledMode = static_cast<LedMode>((static_cast<int>(ledMode) + 1) % 3);
-            lastModeChangeTime = currentTime;
-            Serial.print("Changing mode to: ");
-            Serial.println(ledMode);
-        }
+    // One time for the whole pass
+    unsigned long currentTime = millis();
+    digitalWrite(LED_BUILTIN, currentTime % 1000 < 500);
+    // Touch events since the last pass
+    touchSensor.update();
+    TouchEvent event;
+    while (touchSensor.pop(event)) {
+        // A trace for native/replay when logged
+        ADVANCED_LOG(logger, vv).p("touch ").p(event.micros).p(" ").p(event.pads).ln().send();
+        gestures.onTouch(event.pads, event.micros);
     }
-    // Add brightness control
-    else if (touched & 0b00000001) {
-        // Increase brightness
-        globalBrightness = min(maxBrightness, globalBrightness + brightnessIncrement);
-        if (ledMode != LedMode::GREEN && ledMode != LedMode::RED) {
-            lastMode = ledMode;
-            ledMode = LedMode::GREEN;
-            // Clear the LEDs
-            for (int i = 0; i < LED_COUNT; i++) {
-                leds.setPixelColor(i, 0, 0, 0);
-            }
+    gestures.tick(micros());
+    // The first gesture of this pass that changes what the LEDs show, timed from when it was recognized
+    bool changed = false;
+    uint32_t gestureTime = 0;
+    Gesture gesture;
+    while (gestures.pop(gesture)) {
+        if (handleGesture(gesture) && !changed) {
+            changed = true;
+            gestureTime = gesture.micros;
         }
-    } else if (touched & 0b00000010) {
-        // Decrease brightness
-        globalBrightness = max(minBrightness, globalBrightness - brightnessIncrement);
-        if (ledMode != LedMode::RED && ledMode != LedMode::GREEN) {
-            lastMode = ledMode;
-            ledMode = LedMode::RED;
-            // Clear the LEDs
-            for (int i = 0; i < LED_COUNT; i++) {
-                leds.setPixelColor(i, 0, 0, 0);
-            }
-        }
-    } else {
-        ledMode = lastMode;
-        thresholdReached = false;
     }
 
-    // Update LEDs based on current mode
-    switch (ledMode) {
-    case THUNDER:
-        updateThunderMode();
-        break;
-    case SUNLIGHT:
-        updateSunlightMode(); // Pass the touched variable
-        break;
-    case RAINBOW:
-        updateRainbowMode();
-        break;
-    case RED: {
-        // Set X number of LEDs to red depending on brightness
-        // Clear the LEDs
-        for (int i = 0; i < LED_COUNT; i++) {
-            leds.setPixelColor(i, 0, 0, 0);
-        }
-        int numLEDs = LED_COUNT * globalBrightness / 255;
-        for (int i = 0; i < numLEDs; i++) {
-            leds.setPixelColor(i, 255, 0, 0);
-        }
-        
-        break;
-    }
-    case GREEN: {
-        // Set X number of LEDs to green depending on brightness
-        int numLEDs = LED_COUNT * globalBrightness / 255;
-        for (int i = 0; i < numLEDs; i++) {
-            leds.setPixelColor(i, 0, 255, 0);
-        }
-        break;
-    }
-    }
-    updateBrightness();
+    renderFrame();
+    // The frame showing the gesture is with the LEDs now
+    if (changed)
+        touchLatency.record(micros() - gestureTime);
+    reportTouchLatency(currentTime);
+    logger.drain();
 }
 
-// Base values for thunder effect parameters
-const uint32_t BACKGROUND_BLUE = leds.Color(0, 0, 50);
-uint32_t lightningColor = leds.Color(255, 255, 255);
-const int THUNDER_CHANCE = 10;
-const unsigned long LIGHTNING_DURATION = 50;
-const unsigned long LAST_FLASH_DURATION = 200;
-const unsigned long FLASH_INTERVAL = 100;
-const unsigned long FADE_INTERVAL = 10;
-const unsigned long LIGHTNING_COOLDOWN = 10000;
-const int MAX_LIGHTNING_LENGTH = LED_COUNT / 8;
-const int MIN_FLASHES = 1;
-const int MAX_FLASHES = 6;
-
-unsigned long lastLightningTime = 0;
-unsigned long lastFlashTime = 0;
-unsigned long lastFadeTime = 0;
-bool isLightningSequence = false;
-int currentFlash = 0;
-int totalFlashes = 0;
-int lightningStart = 0;
-int lightningLength = 0;
-int fadingIndex = 0;
-
-void updateThunderMode() {
-    unsigned long currentTime = millis();
-
-    // Check if we're currently in a lightning sequence
-    if (isLightningSequence) {
-        if (currentFlash < totalFlashes) {
-            unsigned long flashDuration = (currentFlash == totalFlashes - 1) ? LAST_FLASH_DURATION + random(-50, 51) : LIGHTNING_DURATION + random(-10, 11);
-
-            // Flash on
-            if (currentTime - lastFlashTime < flashDuration) {
-                for (int i = lightningStart; i < lightningStart + lightningLength; i++) {
-                    leds.setPixelColor(i % LED_COUNT, lightningColor);
-                }
-            }
-            // Flash off (only for non-last flashes)
-            else if (currentFlash < totalFlashes - 1 && currentTime - lastFlashTime < FLASH_INTERVAL + random(-20, 21)) {
-                for (int i = lightningStart; i < lightningStart + lightningLength; i++) {
-                    leds.setPixelColor(i % LED_COUNT, BACKGROUND_BLUE);
-                }
-            }
-            // Start next flash
-            else if (currentFlash < totalFlashes - 1) {
-                currentFlash++;
-                lastFlashTime = currentTime;
-            }
-            // End of last flash
-            else if (currentTime - lastFlashTime >= flashDuration) {
-                isLightningSequence = false;
-                fadingIndex = 0;
-                lastFadeTime = currentTime;
-            }
+// Brighter and dimmer by holding a pad, next mode with both pads, off and on with a double tap.
+// Returns true if the gesture starts a change on the LEDs, the ramp steps of a hold continue one.
+bool handleGesture(const Gesture &gesture) {
+    switch (gesture.type) {
+    case GESTURE_LONG_PRESS:
+        if (!(gesture.pads & (PAD_BRIGHTER | PAD_DIMMER)))
+            return false;
+        showBrightnessBar(gesture.pads == PAD_BRIGHTER ? CRGB(0, 255, 0) : CRGB(255, 0, 0));
+        return true;
+    case GESTURE_RAMP:
+        // A fixed number of levels per second held, however fast the loop runs
+        if (gesture.pads == PAD_BRIGHTER) {
+            globalBrightness = min(maxBrightness, globalBrightness + gesture.steps);
+            showBrightnessBar(CRGB(0, 255, 0));
+        } else {
+            globalBrightness = max(minBrightness, globalBrightness - gesture.steps);
+            showBrightnessBar(CRGB(255, 0, 0));
         }
-        return; // Skip the rest of the function during lightning sequence
+        return false;
+    case GESTURE_HOLD_END: {
+        bool shown = barLayer.isEnabled();
+        barLayer.setEnabled(false);
+        return shown;
     }
-
-    // Fading logic
-    if (fadingIndex < lightningLength) {
-        if (currentTime - lastFadeTime >= FADE_INTERVAL + random(-5, 6)) {
-            int fadePos = (lightningStart + fadingIndex) % LED_COUNT;
-            leds.setPixelColor(fadePos, BACKGROUND_BLUE);
-            fadingIndex++;
-            lastFadeTime = currentTime;
-        }
-        return; // Skip the rest of the function while fading
-    }
-
-    // Set all LEDs to the background blue color
-    for (int i = 0; i < LED_COUNT; i++) {
-        leds.setPixelColor(i, BACKGROUND_BLUE);
-    }
-
-    // Randomly generate lightning
-    if (currentTime - lastLightningTime >= LIGHTNING_COOLDOWN + random(-5000, 5001) &&
-        random(100) < THUNDER_CHANCE) {
-        // Start a new lightning sequence
-        isLightningSequence = true;
-        currentFlash = 0;
-        totalFlashes = random(MIN_FLASHES, MAX_FLASHES + 1); // Random number of flashes
-        lastFlashTime = currentTime;
-        lastLightningTime = currentTime;
-
-        // Determine random start and length for lightning
-        lightningStart = random(LED_COUNT);
-        lightningLength = random(1, MAX_LIGHTNING_LENGTH + 1);
-        // Slightly vary from white
-        lightningColor = leds.Color(235, 235, 235);
-        uint8_t r = (lightningColor >> 16) & 0xFF;
-        uint8_t g = (lightningColor >> 8) & 0xFF;
-        uint8_t b = lightningColor & 0xFF;
-        r += random(-20, 21);
-        g += random(-20, 21);
-        b += random(-20, 21);
-        lightningColor = leds.Color(r, g, b);
-    }
-
-    // Add some subtle variation to the background
-    for (int i = 0; i < LED_COUNT; i++) {
-        if (random(100) < 20) { // 5% chance to slightly vary each LED
-            int variation = random(-15, 16);
-            uint32_t color = leds.Color(0, 0, max(0, min(255, 50 + variation)));
-            leds.setPixelColor(i, color);
+    case GESTURE_TWO_FINGER:
+        // Change LED mode between thunder, sunlight and rainbow
+        ledMode = static_cast<LedMode>((static_cast<int>(ledMode) + 1) % 3);
+        logger.v().p("Changing mode to: ").p((int)ledMode).ln().send();
+        return true;
+    case GESTURE_DOUBLE_TAP:
+        if (globalBrightness > minBrightness) {
+            brightnessBeforeOff = globalBrightness;
+            globalBrightness = minBrightness;
+        } else {
+            globalBrightness = brightnessBeforeOff;
         }
+        return true;
+    case GESTURE_TAP:
+        logger.v().p("Quick touch detected!").ln().send();
+        return false;
     }
+    return false;
 }
 
-void updateSunlightMode(uint32_t clr=leds.Color(255, 128, 0)) {
-    // Set the brightness of each LED to a warmer orange color with flickering effect
-    for (int i = 0; i < LED_COUNT; i++) {
-        int flicker = random(-20, 21);
-        r = constrain(clr >> 16 + flicker, 0, 255);
-        g = constrain((clr >> 8 & 0xFF) + flicker, 0, 255);
-        b = constrain(clr & 0xFF + flicker, 0, 255);
-        leds.setPixelColor(i, r, g, b); // Warmer orange sunlight effect
-    }
+// Render the current mode and its overlays into the framebuffer and send it out with the global brightness
+void renderFrame() {
+    // The other effects keep their state while they are not shown
+    effectLayer.setEffect(getEffect(ledMode));
+    // A summer storm: lightning strikes over the sunlight
+    lightningLayer.setEnabled(ledMode == SUNLIGHT);
+    compositor.render(frameClock.tick());
+    output.setBrightness(globalBrightness);
+    output.write(frame);
+    output.show();
 }
 
-// Function to convert a hue value to a color
-uint32_t Wheel(byte WheelPos) {
-    WheelPos = 255 - WheelPos; // Reverse the wheel for a different effect
-    if (WheelPos < 85) {
-        return leds.Color(255 - WheelPos * 3, 0, WheelPos * 3); // Red to Green
-    } else if (WheelPos < 170) {
-        WheelPos -= 85;
-        return leds.Color(0, WheelPos * 3, 255 - WheelPos * 3); // Green to Blue
-    } else {
-        WheelPos -= 170;
-        return leds.Color(WheelPos * 3, 255 - WheelPos * 3, 0); // Blue to Red
+// Overlay X number of LEDs in the color over the current mode depending on brightness.
+// Only the LEDs between the old and the new end of the bar are touched.
+void showBrightnessBar(const CRGB &color) {
+    static uint16_t shownLength = 0;
+    static CRGB shownColor = CRGB::Black;
+    uint16_t length = LED_COUNT * globalBrightness / 255;
+    if (!barLayer.isEnabled()) {
+        memset(barAlpha, 0, sizeof(barAlpha));
+        shownLength = 0;
+        barLayer.setEnabled(true);
     }
-}
-void updateRainbowMode() {
-    static uint32_t lastUpdateTime = 0; // Last time the rainbow was updated
-    static int hue = 0;                 // Current hue value for the rainbow effect
-    const int speed = 5;                // Speed of the rainbow transition
-
-    // Update the rainbow effect every few milliseconds
-    if (millis() - lastUpdateTime > 20) {
-        lastUpdateTime = millis();
-
-        // Set each LED to the current hue
-        for (int i = 0; i < LED_COUNT; i++) {
-            // Calculate the color based on the current hue and LED index
-            uint32_t color = Wheel((hue + (i * 256 / LED_COUNT)) & 255);
-            leds.setPixelColor(i, color);
-        }
-
-        // Increment the hue for the next frame
-        hue += speed;
-        if (hue >= 256) {
-            hue = 0; // Reset hue to loop the colors
-        }
+    if (color != shownColor) {
+        fill_solid(barPixels, LED_COUNT, color);
+        shownColor = color;
+        barLayer.markDirty(0, length);
+    }
+    if (length != shownLength) {
+        uint16_t first = min(length, shownLength);
+        uint16_t end = max(length, shownLength);
+        memset(barAlpha + first, length > shownLength ? 255 : 0, end - first);
+        barLayer.markDirty(first, end);
+        shownLength = length;
     }
 }
 
-// I hate myself for this
-void updateBrightness() {
-    // Save the current rgb values in an array
-    static uint32_t currentRGB[LED_COUNT];
-    // Get the current brightness for the LEDs
-    for (int i = 0; i < LED_COUNT; i++) {
-        currentRGB[i] = leds.getPixel(i);
-        uint32_t color = leds.getPixel(i);
-        uint8_t r = (color >> 16) & 0xFF;
-        uint8_t g = (color >> 8) & 0xFF;
-        uint8_t b = color & 0xFF;
-        uint8_t newR = max(0, min(255, r * globalBrightness / 255));
-        uint8_t newG = max(0, min(255, g * globalBrightness / 255));
-        uint8_t newB = max(0, min(255, b * globalBrightness / 255));
-        leds.setPixelColor(i, newR, newG, newB);
-    }
-    leds.show();
-    // Set the old brightness values back after show(), so the brightness scaling is not applied repeatedly
-    for (int i = 0; i < LED_COUNT; i++) {
-        leds.setPixelColor(i, currentRGB[i]);
-    }
-}
\ No newline at end of file
+// Every 10 seconds, if a gesture changed the LEDs since the last report
+void reportTouchLatency(unsigned long currentTime) {
+    static unsigned long lastReportTime = 0;
+    if (currentTime - lastReportTime < 10000 || touchLatency.getCount() == 0)
+        return;
+    lastReportTime = currentTime;
+    // Each LED takes 30 us on the wire after the hand-off
+    logger.v().p("Gesture to light: ").p(touchLatency.getCount()).p(" gestures, ").p(touchLatency.getMin()).p("/").p(touchLatency.getAverage())
+        .p("/").p(touchLatency.getMax()).p(" us min/avg/max from recognition to the hand-off, +").p(LED_COUNT * 30).p(" us on the wire").ln().send();
+    logger.v().p("Touch sensor: ").p(touchSensor.getReads()).p(" reads, last ").p(touchSensor.getReadMicros()).p(" us on the bus, ")
+        .p(touchSensor.getMissedAlerts()).p(" missed alerts, ").p(touchSensor.getDropped()).p(" dropped events").ln().send();
+    touchLatency.reset();
+}